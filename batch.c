@@ -0,0 +1,223 @@
+#include "batch.h"
+
+#if BATCH_ENABLE
+
+#include "utils.h"
+#include "calculator.h"
+#include "lcd.h"
+#include "power.h"
+#include "profile.h"
+#include "timer.h"
+
+// Stop ucsim with an undefined opcode on '!' (simulator builds only)
+#ifndef BATCH_SIM_HALT
+#define BATCH_SIM_HALT 0
+#endif
+
+// Frame parser states
+#define FRAME_START 0   // Between frames
+#define FRAME_LINE 1    // Expression ended by a newline
+#define FRAME_LENGTH 2  // Length byte of a length-framed expression
+#define FRAME_COUNTED 3 // Bytes of a length-framed expression
+
+static unsigned char frameState = FRAME_START;
+static unsigned char frameRemaining = 0;   // Bytes left in a length-framed expression
+static unsigned char frameTyped = 0;       // Characters the calculator took
+static unsigned char frameError = CALC_OK; // Error found while typing
+
+// Throughput since the first frame
+static unsigned long batchExpressions = 0;
+static unsigned long batchMilliseconds = 0;
+static unsigned int batchLastTick = 0;
+static bit batchStarted = 0;
+
+/**
+ * @brief Start a new expression
+ */
+static void Batch_BeginFrame(void)
+{
+  if (!batchStarted)
+  {
+    batchStarted = 1;
+    batchLastTick = Timer_GetTicks();
+  }
+
+  Calculator_Clear();
+  frameTyped = 0;
+  frameError = CALC_OK;
+}
+
+/**
+ * @brief Type one expression character
+ * @param ch Character received
+ */
+static void Batch_Type(char ch)
+{
+  if (Calculator_InputChar(ch))
+  {
+    frameTyped++;
+    return;
+  }
+
+  // Rejected: the expression is full or ch is not an expression character
+  if (frameError == CALC_OK)
+  {
+    frameError = (frameTyped >= MAX_EXPR_LEN) ? BATCH_ERR_TOO_LONG : CALC_ERR_SYNTAX;
+  }
+}
+
+/**
+ * @brief Evaluate the expression and send the result line
+ */
+static void Batch_EndFrame(void)
+{
+  char xdata result[LCD_DISPLAY_WIDTH + 1];
+  unsigned char error;
+  unsigned int now;
+
+  error = Calculator_Evaluate(result);
+  if (frameError != CALC_OK)
+  {
+    error = frameError;
+  }
+
+  Uart_PutChar('0' + error);
+  Uart_PutChar(',');
+  if (error == BATCH_ERR_TOO_LONG)
+  {
+    Uart_PutString("Too long");
+  }
+  else if (frameError == CALC_ERR_SYNTAX)
+  {
+    Uart_PutString("Syntax error");
+  }
+  else
+  {
+    Uart_PutString(result);
+  }
+  Uart_PutChar('\n');
+
+  frameState = FRAME_START;
+  batchExpressions++;
+  now = Timer_GetTicks();
+  batchMilliseconds += (unsigned int)(now - batchLastTick) * TICK_MS;
+  batchLastTick = now;
+}
+
+/**
+ * @brief Send the throughput counters
+ */
+static void Batch_SendStats(void)
+{
+  Uart_PutString("stats,");
+  Uart_PutNumber(batchExpressions);
+  Uart_PutChar(',');
+  Uart_PutNumber(batchMilliseconds);
+  Uart_PutChar(',');
+  Uart_PutNumber(batchMilliseconds ? batchExpressions * 1000 / batchMilliseconds : 0);
+  Uart_PutChar(',');
+  Uart_PutNumber(UART_BAUD);
+  Uart_PutChar(',');
+  Uart_PutNumber(Uart_GetOverflowCount());
+  Uart_PutChar('\n');
+}
+
+/**
+ * @brief Handle a command byte at the start of a frame
+ * @param ch Byte received
+ * @return 1=command handled, 0=not a command
+ */
+static unsigned char Batch_Command(char ch)
+{
+  if (ch == '?')
+  {
+    Batch_SendStats();
+    return 1;
+  }
+#if BATCH_SIM_HALT && defined(__SDCC)
+  if (ch == '!')
+  {
+    Uart_Flush();
+    __asm__(".db 0xA5");
+  }
+#endif
+#if PROFILE_ENABLE
+  return Profile_Command(ch);
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Feed one received byte to the frame parser
+ * @param ch Byte received
+ */
+static void Batch_Receive(char ch)
+{
+  switch (frameState)
+  {
+  case FRAME_START:
+    if (ch == '\n' || ch == '\r' || Batch_Command(ch))
+    {
+      return;
+    }
+    Batch_BeginFrame();
+    if (ch == BATCH_SOH)
+    {
+      frameState = FRAME_LENGTH;
+      return;
+    }
+    frameState = FRAME_LINE;
+    Batch_Type(ch);
+    return;
+
+  case FRAME_LINE:
+    if (ch == '\n' || ch == '\r')
+    {
+      Batch_EndFrame();
+      return;
+    }
+    Batch_Type(ch);
+    return;
+
+  case FRAME_LENGTH:
+    frameRemaining = (unsigned char)ch;
+    frameState = FRAME_COUNTED;
+    if (frameRemaining == 0)
+    {
+      Batch_EndFrame();
+    }
+    return;
+
+  default:
+    Batch_Type(ch);
+    if (--frameRemaining == 0)
+    {
+      Batch_EndFrame();
+    }
+    return;
+  }
+}
+
+/**
+ * @brief Run the batch mode (never returns)
+ */
+void Batch_Run(void)
+{
+  char ch;
+
+  LCD_ShowStringAt(0, 0, "UART batch mode");
+  LCD_ShowStringAt(1, 0, "                ");
+
+  while (true)
+  {
+    while (Uart_GetChar(&ch))
+    {
+      Batch_Receive(ch);
+    }
+    LCD_Flush();
+    Power_Idle();
+  }
+}
+
+#endif // BATCH_ENABLE
@@ -0,0 +1,49 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "hal.h"
+
+// ==================== Batch Mode ====================
+// Headless mode: expressions arrive over the serial port instead of the
+// keypad and each one is answered with a line "<error code>,<result>\n"
+// (e.g. "0,3.5", "2,Div by zero"). Frames are either
+//   - an expression ended by '\n' or '\r' (empty lines are skipped), or
+//   - BATCH_SOH, a length byte, then that many expression bytes
+// Characters are evaluated as they arrive while the UART interrupt queues
+// the following bytes, so a host may send the next expression before the
+// previous result has come back (at most UART_RX_QUEUE_SIZE bytes ahead;
+// further bytes are dropped and counted).
+//
+// Single bytes at the start of a frame are commands:
+//   '?'  reply "stats,<expressions>,<ms>,<expressions/s>,<baud>,<dropped bytes>"
+//        counted from the first frame
+//   'p'  'r'  profiler dump and reset (PROFILE_ENABLE builds, see profile.h)
+//   '!'  stop the simulator (BATCH_SIM_HALT builds under ucsim only)
+#ifndef BATCH_ENABLE
+#define BATCH_ENABLE 0
+#endif
+
+// Start of a length-framed expression
+#define BATCH_SOH 0x01
+
+// Error code of an expression longer than MAX_EXPR_LEN (the calculator's
+// codes are 0-3, see calculator.h)
+#define BATCH_ERR_TOO_LONG 4
+
+#if BATCH_ENABLE
+
+#include "uart.h"
+
+#if !UART_ENABLE
+#error "BATCH_ENABLE needs UART_ENABLE=1"
+#endif
+
+/**
+ * @brief Run the batch mode (never returns)
+ * Call after the modules are initialized, instead of the keypad loop
+ */
+void Batch_Run(void);
+
+#endif // BATCH_ENABLE
+
+#endif // BATCH_H
@@ -1,38 +1,121 @@
-#include <reg52.h>
 #include <string.h>
-#include <stdio.h>
 
+#include "hal.h"
 #include "calculator.h"
 #include "stack.h"
+#include "number.h"
+#include "profile.h"
 
 // ==================== Global Variables ====================
 
 // Expression buffer (user input)
+// In streaming mode only the last MAX_EXPR_LEN characters are kept
 static char xdata expressionBuffer[MAX_EXPR_LEN + 1];
 static unsigned char expressionLen = 0;
 
-// Operator precedence table (stored in code memory)
-// Initialized at runtime to avoid C51 designated initializer syntax issues
-static unsigned char xdata operatorPrecedence[128];
+// Position of expressionBuffer[0] in the whole expression (modulo 256),
+// and whether characters were dropped from the front (streaming mode)
+static unsigned char expressionBase = 0;
+static unsigned char expressionTruncated = 0;
+
+// Nothing has been typed since the last clear
+#define IsExpressionEmpty() (expressionLen == 0 && !expressionTruncated)
+
+// ==================== Operator Registry ====================
+
+// Operator associativity
+#define ASSOC_LEFT 0
+#define ASSOC_RIGHT 1
+
+// Operator index meaning "no operator"
+#define NO_OPERATOR 0xFF
+
+// The operator stack holds operator indices; a left parenthesis is kept
+// as '(' which never collides with an index
+#define LPAREN_MARK '('
+
+// Operands and result of the operator being evaluated
+// Handlers take no parameters: C51 can only call through a function
+// pointer when all parameters fit in registers
+static Number opLeft, opRight, opResult;
+
+// Operator descriptor
+typedef struct
+{
+  char symbol;                     // Character in the expression
+  unsigned char precedence;        // Higher binds tighter
+  unsigned char associativity;     // ASSOC_LEFT or ASSOC_RIGHT
+  unsigned char arity;             // Number of operands (a unary operator gets its operand in both)
+  unsigned char (*evaluate)(void); // opResult = opLeft op opRight, returns CALC_OK or error code
+} OperatorInfo;
+
+static unsigned char EvaluateAdd(void)
+{
+  return Number_Add(opLeft, opRight, &opResult) ? CALC_OK : CALC_ERR_OVERFLOW;
+}
+
+static unsigned char EvaluateSub(void)
+{
+  return Number_Sub(opLeft, opRight, &opResult) ? CALC_OK : CALC_ERR_OVERFLOW;
+}
+
+static unsigned char EvaluateMul(void)
+{
+  return Number_Mul(opLeft, opRight, &opResult) ? CALC_OK : CALC_ERR_OVERFLOW;
+}
+
+static unsigned char EvaluateDiv(void)
+{
+  if (Number_IsZero(opRight))
+  {
+    return CALC_ERR_DIV_ZERO;
+  }
+  return Number_Div(opLeft, opRight, &opResult) ? CALC_OK : CALC_ERR_OVERFLOW;
+}
+
+// Operator table (stored in code memory)
+// The handlers are only called through this table, see the OVERLAY
+// directive in the project's linker settings
+static OperatorInfo code operators[] = {
+    {OP_ADD, 1, ASSOC_LEFT, 2, EvaluateAdd},
+    {OP_SUB, 1, ASSOC_LEFT, 2, EvaluateSub},
+    {OP_MUL, 2, ASSOC_LEFT, 2, EvaluateMul},
+    {OP_DIV, 2, ASSOC_LEFT, 2, EvaluateDiv}};
+
+#define OPERATOR_COUNT (sizeof(operators) / sizeof(operators[0]))
 
 /**
- * Initialize operator precedence table
+ * Find the operator for an expression character
+ * @return Operator index, or NO_OPERATOR if ch is not an operator
  */
-static void InitOperatorPrecedence(void)
+static unsigned char FindOperator(char ch)
 {
   unsigned char i;
-  // Clear all entries
-  for (i = 0; i < 128; i++)
+
+  for (i = 0; i < OPERATOR_COUNT; i++)
   {
-    operatorPrecedence[i] = 0;
+    if (operators[i].symbol == ch)
+    {
+      return i;
+    }
   }
-  // Set operator precedences
-  operatorPrecedence['('] = 0;
-  operatorPrecedence[')'] = 0;
-  operatorPrecedence['+'] = 1;
-  operatorPrecedence['-'] = 1;
-  operatorPrecedence['*'] = 2;
-  operatorPrecedence['/'] = 2;
+  return NO_OPERATOR;
+}
+
+/**
+ * Perform an operation
+ * @param op Operator index
+ * @return CALC_OK or error code
+ */
+static unsigned char PerformOperation(unsigned char op, Number operand1, Number operand2, Number *result)
+{
+  unsigned char error;
+
+  opLeft = operand1;
+  opRight = operand2;
+  error = operators[op].evaluate();
+  *result = opResult;
+  return error;
 }
 
 // ==================== Helper Functions ====================
@@ -45,520 +128,751 @@ static unsigned char IsDigitOrDot(char ch)
   return (ch >= '0' && ch <= '9') || ch == '.';
 }
 
+// ==================== Incremental Evaluation ====================
+//
+// The expression is parsed one character at a time as it is typed. Numbers
+// are pushed straight onto the operand stack, and every operator the
+// Shunting Yard algorithm would emit to the RPN output is applied to the
+// operand stack immediately instead. Operators are therefore reduced in
+// exactly the same order as an RPN evaluation, without a token queue.
+//
+// Before a character is consumed, the parser state is saved on a ring of
+// packed checkpoints. The checkpoints hold no copy of the current number, so
+// the characters after the start of a number (up to and including the one
+// that ends it) and characters after a syntax error get none: backspace
+// restores the newest checkpoint and replays the characters after it from
+// expressionBuffer (at most one number and the character after it). If the
+// checkpoint was dropped, the expression is replayed from its start.
+// After each character the end of the expression is evaluated on the side,
+// without changing the stacks, which keeps a ready-made result for preview
+// and for '='.
+
+// Parser flags
+#define PARSE_IN_NUMBER 0x01    // A number is being accumulated
+#define PARSE_HAS_DOT 0x02      // Current number has a decimal point
+#define PARSE_NEGATIVE 0x04     // Current number has a negative sign
+#define PARSE_SYNTAX_ERROR 0x08 // Syntax error found, rest of input is ignored
+
+// Parser state (everything except the stack contents and the current number)
+typedef struct
+{
+  unsigned char lastTokenType; // Type of the previous token (to detect negative numbers)
+  unsigned char parenCount;    // Number of unmatched left parentheses
+  unsigned char evalError;     // First evaluation error (see below)
+  unsigned char flags;         // PARSE_* flags
+} ParseState;
+
+// Packed parser state for the checkpoint ring
+typedef struct
+{
+  StackMark stacks;         // Operator and operand stack positions
+  unsigned char parenCount; // Number of unmatched left parentheses
+  unsigned char packed;     // flags | lastTokenType << 4 | evalError << 6
+  unsigned char position;   // Position of the character it precedes (see expressionBase)
+} Checkpoint;
+
+// Live parser state
+// evalError holds the first evaluation error. Syntax errors found later in
+// the expression take priority over it, so it is only reported once the
+// whole expression parsed successfully.
+static ParseState xdata parser;
+
+// Current number (only valid while PARSE_IN_NUMBER is set)
+static NumberBuilder xdata number;
+
+// Ring of checkpoints in expression order; a full ring drops the oldest
+static Checkpoint xdata checkpoints[CALC_CHECKPOINTS];
+static unsigned char checkpointFirst = 0;
+static unsigned char checkpointCount = 0;
+
+#define NewestCheckpoint() (&checkpoints[(checkpointFirst + checkpointCount - 1) % CALC_CHECKPOINTS])
+
+// Result of the current expression, updated after every change
+static Number previewValue;
+static unsigned char previewError = CALC_OK;
+
+// Operator applied last while completing the expression, and its right
+// operand (NO_OPERATOR if completing the expression applied none).
+// Operators already applied inside closed parentheses are not recorded:
+// "2+3" repeats +3, "2*(3+4)" repeats *7 and "(2+3)" repeats nothing.
+static unsigned char repeatOp = NO_OPERATOR;
+static Number repeatOperand;
+
+// Expression generation, bumped on every change of the expression
+static unsigned char expressionGeneration = 0;
+
+// Cached result of Calculator_Evaluate, valid while evaluatedGeneration
+// matches expressionGeneration
+static unsigned char evaluatedGeneration = 0;
+static Number resultValue;
+static unsigned char resultError = CALC_OK;
+static char xdata resultText[LCD_DISPLAY_WIDTH + 1];
+
 /**
- * Check if character is an operator
+ * Reset parser to the start of an empty expression
  */
-static unsigned char IsOperator(char ch)
+static void ResetParser(void)
 {
-  return ch == '+' || ch == '-' || ch == '*' || ch == '/';
+  CharStack_Init();
+  NumberStack_Init();
+  Journal_Init();
+  parser.lastTokenType = TOKEN_OPERATOR; // Assume operator at start
+  parser.parenCount = 0;
+  parser.evalError = CALC_OK;
+  parser.flags = 0;
+  checkpointFirst = 0;
+  checkpointCount = 0;
+  repeatOp = NO_OPERATOR;
 }
 
 /**
- * Get operator precedence
+ * Mark the expression as changed (invalidates the cached result)
  */
-static unsigned char GetPrecedence(char op)
+static void ExpressionChanged(void)
 {
-  return operatorPrecedence[(unsigned char)op];
+  expressionGeneration++;
+
+  // Never let the counter wrap around onto the cached generation
+  if (expressionGeneration == evaluatedGeneration)
+  {
+    evaluatedGeneration--;
+  }
 }
 
 /**
- * Perform binary operation
- * @return CALC_OK or error code
+ * Save the live parser state (except the current number) on the
+ * checkpoint ring, dropping the oldest checkpoint if the ring is full
+ * @param index Index in expressionBuffer of the character about to be consumed
  */
-static unsigned char PerformOperation(char op, float operand1, float operand2, float *result)
-{
-  switch (op)
-  {
-  case '+':
-    *result = operand1 + operand2;
-    return CALC_OK;
-  case '-':
-    *result = operand1 - operand2;
-    return CALC_OK;
-  case '*':
-    *result = operand1 * operand2;
-    return CALC_OK;
-  case '/':
-    if (operand2 == 0.0 || operand2 == -0.0)
-    {
-      return CALC_ERR_DIV_ZERO;
-    }
-    *result = operand1 / operand2;
-    return CALC_OK;
-  default:
-    return CALC_ERR_SYNTAX;
+static void PushCheckpoint(unsigned char index)
+{
+  Checkpoint xdata *checkpoint;
+
+  if (checkpointCount == CALC_CHECKPOINTS)
+  {
+    checkpointFirst = (checkpointFirst + 1) % CALC_CHECKPOINTS;
+    checkpointCount--;
   }
+  checkpoint = &checkpoints[(checkpointFirst + checkpointCount) % CALC_CHECKPOINTS];
+  checkpointCount++;
+
+  Stack_Save(&checkpoint->stacks);
+  checkpoint->parenCount = parser.parenCount;
+  checkpoint->packed = parser.flags | (parser.lastTokenType << 4) | (parser.evalError << 6);
+  checkpoint->position = expressionBase + index;
 }
 
 /**
- * Convert string to float (manual implementation to avoid library dependencies)
+ * Restore the newest checkpoint and remove it from the ring
+ * The current number is not restored; it is rebuilt by replaying its
+ * characters
+ * @return Index in expressionBuffer of the character the checkpoint
+ *         precedes, or 0xFF if there is no checkpoint or its stack journal
+ *         entries were dropped
  */
-static float StringToFloat(const char *str, unsigned char len)
+static unsigned char PopCheckpoint(void)
 {
-  float result = 0.0;
-  float decimal = 0.0;
-  unsigned char i = 0;
-  unsigned char isNegative = 0;
-  unsigned char afterDot = 0;
-  float divisor = 10.0;
+  Checkpoint xdata *checkpoint;
 
-  // Negative sign
-  if (str[0] == '-')
+  if (checkpointCount == 0)
   {
-    isNegative = 1;
-    i = 1;
+    return 0xFF;
   }
-
-  for (; i < len; i++)
+  checkpoint = NewestCheckpoint();
+  if (!Stack_CanRestore(&checkpoint->stacks))
   {
-    if (str[i] == '.')
-    {
-      afterDot = 1;
-      continue;
-    }
+    return 0xFF;
+  }
 
-    // Is number
-    if (str[i] >= '0' && str[i] <= '9')
-    {
-      if (!afterDot)
-      {
-        result = result * 10.0 + (str[i] - '0');
-      }
-      else
-      {
-        decimal = decimal + (str[i] - '0') / divisor;
-        divisor *= 10.0;
-      }
-    }
+  Stack_Restore(&checkpoint->stacks);
+  parser.parenCount = checkpoint->parenCount;
+  parser.flags = checkpoint->packed & 0x0F;
+  parser.lastTokenType = (checkpoint->packed >> 4) & 0x03;
+  parser.evalError = checkpoint->packed >> 6;
+  checkpointCount--;
+  return checkpoint->position - expressionBase;
+}
+
+/**
+ * Push an operand onto the operand stack
+ * @param value The operand value
+ */
+static void PushOperand(Number value)
+{
+  if (parser.evalError != CALC_OK)
+  {
+    return;
   }
 
-  result += decimal;
-  if (isNegative)
+  if (NumberStack_IsFull())
   {
-    result = -result;
+    parser.evalError = CALC_ERR_OVERFLOW;
+    return;
   }
-  return result;
+  NumberStack_Push(value);
 }
 
 /**
- * Convert float to string (5 decimal places)
+ * Push an operator or left parenthesis onto the operator stack
+ * @param op Operator index or LPAREN_MARK
  */
-static void FloatToString(float value, char *buffer)
+static void PushOperator(unsigned char op)
 {
-  long intPart;
-  long fracPart;
-  unsigned char i;
-  unsigned char negative = 0;
-
-  // Handle negative numbers
-  if (value < 0)
+  if (!CharStack_Push(op) && parser.evalError == CALC_OK)
   {
-    negative = 1;
-    value = -value;
+    parser.evalError = CALC_ERR_OVERFLOW; // Arena full
   }
+}
 
-  // Round to 5 decimal places
-  value += 0.000005;
-
-  // Extract integer and fractional parts
-  intPart = (long)value;
-  fracPart = (long)((value - intPart) * 100000);
+/**
+ * Apply an operator to the top operands of the operand stack
+ * @param op Index of the operator to apply
+ */
+static void ApplyOperator(unsigned char op)
+{
+  Number operand1, operand2;
+  Number result;
 
-  // Format output using sprintf
-  if (negative)
+  if (parser.evalError != CALC_OK)
   {
-    sprintf(buffer, "-%ld.%05ld", intPart, fracPart);
+    return;
   }
-  else
+
+  // Pop the operands
+  if (NumberStack_Size() < operators[op].arity)
   {
-    sprintf(buffer, "%ld.%05ld", intPart, fracPart);
+    parser.evalError = CALC_ERR_SYNTAX; // Insufficient operands
+    return;
   }
+  operand2 = NumberStack_Pop();
+  operand1 = (operators[op].arity == 2) ? NumberStack_Pop() : operand2;
 
-  // Remove trailing zeros (keep at least 1 decimal place)
-  i = strlen(buffer) - 1;
-  while (i > 0 && buffer[i] == '0' && buffer[i - 1] != '.')
+  // Perform operation and push result onto stack
+  PROFILE_BEGIN(PROFILE_APPLY);
+  parser.evalError = PerformOperation(op, operand1, operand2, &result);
+  PROFILE_END(PROFILE_APPLY);
+  if (parser.evalError == CALC_OK)
   {
-    buffer[i] = '\0';
-    i--;
+    NumberStack_Push(result);
   }
 }
 
-// ==================== Lexical Analysis ====================
-
 /**
- * Tokenize: Convert expression string to token sequence
- * @return CALC_OK or error code
+ * Add a digit or decimal point to the current number
+ * @param ch Digit or '.'
  */
-static unsigned char Tokenize(void)
+static void AccumulateDigit(char ch)
 {
-  unsigned char i = 0;
-  char xdata numBuffer[16];
-  unsigned char numLen = 0;
-  unsigned char hasDot = 0;
-  Token token;
-  unsigned char lastTokenType = TOKEN_OPERATOR; // Assume operator at start
-
-  TokenQueue_Init();
-
-  while (i < expressionLen)
+  if (ch == '.')
   {
-    char ch = expressionBuffer[i];
-
-    // Skip whitespace
-    if (ch == ' ')
+    if (parser.flags & PARSE_HAS_DOT)
     {
-      i++;
-      continue;
-    }
-
-    // Process numbers (including negative numbers)
-    // Negative sign is treated as part of number if:
-    // - At the beginning of expression
-    // - After an operator
-    // - After a left parenthesis
-    if ((ch >= '0' && ch <= '9') || ch == '.' ||
-        (ch == '-' && (lastTokenType == TOKEN_OPERATOR || lastTokenType == TOKEN_LPAREN)))
-    {
-      numLen = 0;
-      hasDot = 0;
-
-      // Include negative sign in number
-      if (ch == '-')
-      {
-        numBuffer[numLen++] = expressionBuffer[i++];
-      }
-
-      while (i < expressionLen && IsDigitOrDot(expressionBuffer[i]))
-      {
-        if (expressionBuffer[i] == '.')
-        {
-          if (hasDot)
-          {
-            return CALC_ERR_SYNTAX; // Multiple decimal points
-          }
-          hasDot = 1;
-        }
-        numBuffer[numLen++] = expressionBuffer[i++];
-      }
-
-      numBuffer[numLen] = '\0';
-      token.type = TOKEN_NUMBER;
-      token.value = StringToFloat(numBuffer, numLen);
-      TokenQueue_Add(token);
-      lastTokenType = TOKEN_NUMBER;
-      continue;
-    }
-
-    // Process operators
-    if (IsOperator(ch))
-    {
-      token.type = TOKEN_OPERATOR;
-      token.op = ch;
-      TokenQueue_Add(token);
-      lastTokenType = TOKEN_OPERATOR;
-      i++;
-      continue;
+      parser.flags |= PARSE_SYNTAX_ERROR; // Multiple decimal points
+      return;
     }
+    parser.flags |= PARSE_HAS_DOT;
+    return;
+  }
 
-    // Process left parenthesis
-    if (ch == '(')
-    {
-      token.type = TOKEN_LPAREN;
-      TokenQueue_Add(token);
-      lastTokenType = TOKEN_LPAREN;
-      i++;
-      continue;
-    }
+  Number_BuildDigit(&number, ch - '0', (parser.flags & PARSE_HAS_DOT) != 0);
+}
 
-    // Process right parenthesis
-    if (ch == ')')
-    {
-      token.type = TOKEN_RPAREN;
-      TokenQueue_Add(token);
-      lastTokenType = TOKEN_RPAREN;
-      i++;
-      continue;
-    }
+/**
+ * Start a new number
+ * @param ch First character of the number (digit, '.' or '-')
+ */
+static void BeginNumber(char ch)
+{
+  parser.flags = (parser.flags & ~(PARSE_HAS_DOT | PARSE_NEGATIVE)) | PARSE_IN_NUMBER;
+  Number_BuildBegin(&number);
 
-    // Illegal character
-    return CALC_ERR_SYNTAX;
+  // Include negative sign in number
+  if (ch == '-')
+  {
+    parser.flags |= PARSE_NEGATIVE;
+  }
+  else
+  {
+    AccumulateDigit(ch);
   }
-
-  return CALC_OK;
 }
 
-// ==================== Shunting Yard Algorithm (Infix to RPN) ====================
-
 /**
- * Handle number token in Shunting Yard algorithm
- * Numbers are directly added to the output queue
- * @param token The number token to process
- * @param rpnOutput The RPN output array
- * @param rpnLen Pointer to the current length of RPN output
+ * Finish the current number and push it onto the operand stack
  */
-static void HandleNumberToken(Token token, Token xdata *rpnOutput, unsigned char *rpnLen)
+static void EndNumber(void)
 {
-  rpnOutput[(*rpnLen)++] = token;
+  Number value;
+
+  parser.flags &= ~PARSE_IN_NUMBER;
+  parser.lastTokenType = TOKEN_NUMBER;
+
+  if (!Number_BuildEnd(&number, parser.flags & PARSE_NEGATIVE, &value))
+  {
+    // Number out of range
+    if (parser.evalError == CALC_OK)
+    {
+      parser.evalError = CALC_ERR_OVERFLOW;
+    }
+    return;
+  }
+  PushOperand(value);
 }
 
 /**
- * Handle operator token in Shunting Yard algorithm
- * Pops operators with higher or equal precedence from stack to output
- * @param token The operator token to process
- * @param rpnOutput The RPN output array
- * @param rpnLen Pointer to the current length of RPN output
+ * Handle an operator
+ * Applies operators with higher precedence (or equal precedence for a left
+ * associative operator), then pushes the operator
+ * @param op Index of the operator to process
  */
-static void HandleOperatorToken(Token token, Token xdata *rpnOutput, unsigned char *rpnLen)
+static void HandleOperator(unsigned char op)
 {
-  Token outputToken;
-  char topOp;
+  unsigned char topOp;
 
-  // Pop operators with precedence >= current operator
+  // Apply operators that bind tighter than the current operator
   while (!CharStack_IsEmpty())
   {
     topOp = CharStack_Peek();
-    if (topOp == '(' || GetPrecedence(topOp) < GetPrecedence(token.op))
+    if (topOp == LPAREN_MARK || operators[topOp].precedence < operators[op].precedence)
     {
       break;
     }
-
-    outputToken.type = TOKEN_OPERATOR;
-    outputToken.op = CharStack_Pop();
-    rpnOutput[(*rpnLen)++] = outputToken;
+    if (operators[topOp].precedence == operators[op].precedence &&
+        operators[op].associativity == ASSOC_RIGHT)
+    {
+      break;
+    }
+    ApplyOperator(CharStack_Pop());
   }
 
   // Push current operator onto stack
-  CharStack_Push(token.op);
+  PushOperator(op);
 }
 
 /**
- * Handle left parenthesis token in Shunting Yard algorithm
- * Left parenthesis is pushed onto the operator stack
- * @param parenCount Pointer to the parenthesis counter
- */
-static void HandleLeftParenToken(unsigned char *parenCount)
-{
-  CharStack_Push('(');
-  (*parenCount)++;
-}
-
-/**
- * Handle right parenthesis token in Shunting Yard algorithm
- * Pops operators until matching left parenthesis is found
- * @param rpnOutput The RPN output array
- * @param rpnLen Pointer to the current length of RPN output
- * @param parenCount Pointer to the parenthesis counter
+ * Handle a right parenthesis
+ * Applies operators until the matching left parenthesis is found
  * @return CALC_OK or error code
  */
-static unsigned char HandleRightParenToken(Token xdata *rpnOutput, unsigned char *rpnLen, unsigned char *parenCount)
+static unsigned char HandleRightParen(void)
 {
-  Token outputToken;
-  char topOp;
+  unsigned char topOp;
 
   // Check for matching left parenthesis
-  if (*parenCount == 0)
+  if (parser.parenCount == 0)
   {
     return CALC_ERR_SYNTAX; // Unmatched parenthesis
   }
 
-  // Pop operators until left parenthesis is found
+  // Apply operators until left parenthesis is found
+  // After an overflow the left parenthesis may be missing from the stack,
+  // so parenCount follows the input rather than the stack
   while (!CharStack_IsEmpty())
   {
     topOp = CharStack_Pop();
-    if (topOp == '(')
+    if (topOp == LPAREN_MARK)
     {
-      (*parenCount)--;
       break;
     }
-    outputToken.type = TOKEN_OPERATOR;
-    outputToken.op = topOp;
-    rpnOutput[(*rpnLen)++] = outputToken;
+    ApplyOperator(topOp);
   }
+  parser.parenCount--;
 
   return CALC_OK;
 }
 
 /**
- * Shunting Yard Algorithm: Convert token sequence to Reverse Polish Notation (RPN)
- * @return CALC_OK or error code
+ * Feed one expression character to the parser
+ * @param ch Input character
  */
-static unsigned char ShuntingYard(void)
+static void ParseChar(char ch)
 {
-  unsigned char i;
-  Token token;
-  Token outputToken;
-  char topOp;
-  unsigned char parenCount = 0;
-  Token xdata rpnOutput[MAX_TOKEN_QUEUE];
-  unsigned char rpnLen = 0;
-  unsigned char errCode;
-
-  CharStack_Init();
+  unsigned char op;
 
-  // Process each token
-  for (i = 0; i < TokenQueue_Length(); i++)
+  // Nothing after a syntax error can change the result
+  if (parser.flags & PARSE_SYNTAX_ERROR)
   {
-    token = *TokenQueue_Get(i);
+    return;
+  }
 
-    switch (token.type)
+  // Continue current number
+  if (parser.flags & PARSE_IN_NUMBER)
+  {
+    if (IsDigitOrDot(ch))
     {
-    case TOKEN_NUMBER:
-      HandleNumberToken(token, rpnOutput, &rpnLen);
-      break;
+      AccumulateDigit(ch);
+      return;
+    }
+    EndNumber();
+  }
 
-    case TOKEN_OPERATOR:
-      HandleOperatorToken(token, rpnOutput, &rpnLen);
-      break;
+  // Start a number (including negative numbers)
+  // Negative sign is treated as part of number if:
+  // - At the beginning of expression
+  // - After an operator
+  // - After a left parenthesis
+  if (IsDigitOrDot(ch) ||
+      (ch == '-' && (parser.lastTokenType == TOKEN_OPERATOR || parser.lastTokenType == TOKEN_LPAREN)))
+  {
+    BeginNumber(ch);
+    return;
+  }
 
-    case TOKEN_LPAREN:
-      HandleLeftParenToken(&parenCount);
-      break;
+  // Process operators
+  op = FindOperator(ch);
+  if (op != NO_OPERATOR)
+  {
+    HandleOperator(op);
+    parser.lastTokenType = TOKEN_OPERATOR;
+    return;
+  }
+
+  // Process left parenthesis
+  if (ch == '(')
+  {
+    // Counted even if the arena is full, so the parentheses are still
+    // matched and a syntax error takes priority over the overflow
+    PushOperator(LPAREN_MARK);
+    parser.parenCount++;
+    parser.lastTokenType = TOKEN_LPAREN;
+    return;
+  }
+
+  // Process right parenthesis
+  if (ch == ')' && HandleRightParen() == CALC_OK)
+  {
+    parser.lastTokenType = TOKEN_RPAREN;
+    return;
+  }
+
+  // Unmatched parenthesis or illegal character
+  parser.flags |= PARSE_SYNTAX_ERROR;
+}
+
+/**
+ * Feed the character at the end of the expression to the parser, saving a
+ * checkpoint first unless a number is being accumulated
+ * @param ch Input character
+ * @param index Index of ch in expressionBuffer
+ */
+static void ConsumeChar(char ch, unsigned char index)
+{
+  // Inside a number the checkpoint would lack the digits so far
+  if (!(parser.flags & (PARSE_SYNTAX_ERROR | PARSE_IN_NUMBER)))
+  {
+    PushCheckpoint(index);
+  }
+
+  PROFILE_BEGIN(PROFILE_PARSE);
+  ParseChar(ch);
+  PROFILE_END(PROFILE_PARSE);
+}
 
-    case TOKEN_RPAREN:
-      errCode = HandleRightParenToken(rpnOutput, &rpnLen, &parenCount);
-      if (errCode != CALC_OK)
+/**
+ * Complete the expression without changing the parser state: the current
+ * number and the operators left on the operator stack are applied the way
+ * the end of the expression applies them, but the intermediate results
+ * are kept in a local variable instead of the operand stack
+ * @param result Pointer to store the result
+ * @return CALC_OK or error code
+ */
+static unsigned char FinishExpression(Number *result)
+{
+  unsigned char error = parser.evalError;
+  unsigned char operands = NumberStack_Size(); // Operands left as the operators are applied
+  unsigned char below = 1;                     // Depth of the next left operand in the operand stack
+  unsigned char depth;
+  unsigned char op;
+  Number top; // Top operand
+  Number left, right;
+
+  // Syntax errors take priority over evaluation errors; an unmatched left
+  // parenthesis is still on the operator stack
+  if ((parser.flags & PARSE_SYNTAX_ERROR) || parser.parenCount != 0)
+  {
+    return CALC_ERR_SYNTAX;
+  }
+
+  // The current number goes on top of the operand stack
+  if (parser.flags & PARSE_IN_NUMBER)
+  {
+    if (!Number_BuildEnd(&number, parser.flags & PARSE_NEGATIVE, &top))
+    {
+      if (error == CALC_OK)
       {
-        return errCode;
+        error = CALC_ERR_OVERFLOW;
       }
-      break;
-
-    default:
-      return CALC_ERR_SYNTAX;
+    }
+    else if (error == CALC_OK && NumberStack_IsFull())
+    {
+      error = CALC_ERR_OVERFLOW;
+    }
+    else
+    {
+      operands++;
+      below = 0;
     }
   }
+  if (below != 0 && operands > 0)
+  {
+    top = NumberStack_PeekAt(0);
+  }
 
-  // Pop all remaining operators from stack
-  while (!CharStack_IsEmpty())
+  // Apply the remaining operators, top first
+  // The last one applied is kept in repeatOp for repeated '='
+  repeatOp = NO_OPERATOR;
+  for (depth = 0; error == CALC_OK && depth < CharStack_Size(); depth++)
   {
-    topOp = CharStack_Pop();
-    if (topOp == '(')
+    op = CharStack_PeekAt(depth);
+    if (operands < operators[op].arity)
     {
-      return CALC_ERR_SYNTAX; // Unmatched parenthesis
+      return CALC_ERR_SYNTAX; // Insufficient operands
     }
-    outputToken.type = TOKEN_OPERATOR;
-    outputToken.op = topOp;
-    rpnOutput[rpnLen++] = outputToken;
+    left = (operators[op].arity == 2) ? NumberStack_PeekAt(below++) : top;
+
+    right = top;
+    PROFILE_BEGIN(PROFILE_APPLY);
+    error = PerformOperation(op, left, right, &top);
+    PROFILE_END(PROFILE_APPLY);
+    if (error == CALC_OK)
+    {
+      repeatOp = op;
+      repeatOperand = right;
+    }
+    operands -= operators[op].arity - 1;
   }
 
-  // Check parenthesis balance
-  if (parenCount != 0)
+  if (error != CALC_OK)
   {
-    return CALC_ERR_SYNTAX;
+    return error;
   }
 
-  // Copy RPN output to tokenQueue
-  TokenQueue_Init();
-  for (i = 0; i < rpnLen; i++)
+  // Exactly one result must be left
+  if (operands != 1)
   {
-    TokenQueue_Add(rpnOutput[i]);
+    return CALC_ERR_SYNTAX;
   }
 
+  *result = top;
   return CALC_OK;
 }
 
-// ==================== RPN Evaluation ====================
+/**
+ * Recompute the preview result
+ */
+static void UpdatePreview(void)
+{
+  PROFILE_BEGIN(PROFILE_FINISH);
+  previewError = FinishExpression(&previewValue);
+  PROFILE_END(PROFILE_FINISH);
+}
+
+// ==================== Result Cache ====================
+
+#if CALC_CACHE_SIZE > 0
+
+// Hash of the expression, updated incrementally as characters are typed
+static unsigned int expressionHash = 0;
 
 /**
- * RPN Evaluation: Evaluate the RPN token sequence
- * @return CALC_OK or error code
+ * Add one character to an expression hash
  */
-static unsigned char EvaluateRPN(float *result)
+static unsigned int HashChar(unsigned int hash, char ch)
 {
-  unsigned char i;
-  Token token;
-  float operand1, operand2;
-  float opResult;
-  unsigned char errCode;
+  return (hash << 5) - hash + (unsigned char)ch; // hash * 31 + ch
+}
 
-  FloatStack_Init();
+/**
+ * Remove the last character from an expression hash (the inverse of
+ * HashChar: 0x7BDF * 31 = 1 modulo 2^16)
+ */
+static unsigned int UnhashChar(unsigned int hash, char ch)
+{
+  return (hash - (unsigned char)ch) * 0x7BDF;
+}
 
-  for (i = 0; i < TokenQueue_Length(); i++)
-  {
-    token = *TokenQueue_Get(i);
+// Cached result of a recently evaluated expression
+typedef struct
+{
+  unsigned int hash;                  // Expression hash
+  unsigned char error;                // Error code
+  char expression[MAX_EXPR_LEN + 1];  // Expression (guards against collisions)
+  char text[LCD_DISPLAY_WIDTH + 1];   // Formatted result
+} CacheEntry;
 
-    if (token.type == TOKEN_NUMBER)
-    {
-      // Push number onto stack
-      if (FloatStack_IsFull())
-      {
-        return CALC_ERR_OVERFLOW;
-      }
-      FloatStack_Push(token.value);
-    }
-    else if (token.type == TOKEN_OPERATOR)
-    {
-      // Pop two operands
-      if (FloatStack_Size() < 2)
-      {
-        return CALC_ERR_SYNTAX; // Insufficient operands
-      }
-      operand2 = FloatStack_Pop();
-      operand1 = FloatStack_Pop();
+// Cached entries, in no particular order
+static CacheEntry xdata cache[CALC_CACHE_SIZE];
+static unsigned char cacheCount = 0;
 
-      // Perform operation
-      errCode = PerformOperation(token.op, operand1, operand2, &opResult);
-      if (errCode != CALC_OK)
-      {
-        return errCode;
-      }
+// Indices into cache from most to least recently used, so a lookup or an
+// insert moves single bytes instead of whole entries
+static unsigned char xdata cacheOrder[CALC_CACHE_SIZE];
 
-      // Push result onto stack
-      FloatStack_Push(opResult);
+// Lookup statistics
+static unsigned int cacheHits = 0;
+static unsigned int cacheMisses = 0;
+
+/**
+ * Make an entry the most recently used
+ * @param rank Position of the entry in cacheOrder, must be < cacheCount
+ * @return Index of the entry in cache
+ */
+static unsigned char CacheMoveToFront(unsigned char rank)
+{
+  unsigned char index = cacheOrder[rank];
+
+  memmove(cacheOrder + 1, cacheOrder, rank);
+  cacheOrder[0] = index;
+  return index;
+}
+
+/**
+ * Look up the current expression in the cache
+ * @return 1=hit (resultText/resultError set), 0=miss
+ */
+static unsigned char CacheLookup(void)
+{
+  CacheEntry xdata *entry;
+  unsigned char rank;
+
+  for (rank = 0; rank < cacheCount; rank++)
+  {
+    entry = &cache[cacheOrder[rank]];
+    if (entry->hash == expressionHash && strcmp(entry->expression, expressionBuffer) == 0)
+    {
+      CacheMoveToFront(rank);
+      resultError = entry->error;
+      strcpy(resultText, entry->text);
+      cacheHits++;
+      return 1;
     }
   }
 
-  // Stack should contain exactly one result
-  if (FloatStack_Size() != 1)
+  cacheMisses++;
+  return 0;
+}
+
+/**
+ * Insert the current expression and its result, evicting the least
+ * recently used entry if the cache is full
+ */
+static void CacheInsert(void)
+{
+  CacheEntry xdata *entry;
+
+  if (cacheCount < CALC_CACHE_SIZE)
   {
-    return CALC_ERR_SYNTAX;
+    cacheOrder[cacheCount] = cacheCount;
+    cacheCount++;
   }
+  entry = &cache[CacheMoveToFront(cacheCount - 1)];
 
-  *result = FloatStack_Pop();
-  return CALC_OK;
+  entry->hash = expressionHash;
+  entry->error = resultError;
+  strcpy(entry->expression, expressionBuffer);
+  strcpy(entry->text, resultText);
 }
 
+#endif
+
 // ==================== Public Interface Functions ====================
 
 void Calculator_Init(void)
 {
-  InitOperatorPrecedence();
-  expressionLen = 0;
-  expressionBuffer[0] = '\0';
+  Calculator_Clear();
 }
 
 unsigned char Calculator_InputChar(char ch)
 {
-  // Check if buffer is full
-  if (expressionLen >= MAX_EXPR_LEN)
+  // Check if character is valid
+  if (!IsDigitOrDot(ch) && FindOperator(ch) == NO_OPERATOR && ch != '(' && ch != ')')
   {
     return 0;
   }
 
-  // Check if character is valid
-  if (!IsDigitOrDot(ch) && !IsOperator(ch) && ch != '(' && ch != ')')
+  // Check if buffer is full
+  if (expressionLen >= MAX_EXPR_LEN)
   {
+#if CALC_STREAMING
+    // Drop the oldest character and its checkpoint; it was consumed
+    // already and only the display and backspace need the text
+    if (checkpointCount > 0 && checkpoints[checkpointFirst].position == expressionBase)
+    {
+      checkpointFirst = (checkpointFirst + 1) % CALC_CHECKPOINTS;
+      checkpointCount--;
+    }
+    memmove(expressionBuffer, expressionBuffer + 1, MAX_EXPR_LEN);
+    expressionLen--;
+    expressionBase++;
+    expressionTruncated = 1;
+#else
     return 0;
+#endif
   }
 
+  // Save parser state for backspace, then parse the character
+  ConsumeChar(ch, expressionLen);
+  UpdatePreview();
+  ExpressionChanged();
+
   // Add character
   expressionBuffer[expressionLen++] = ch;
   expressionBuffer[expressionLen] = '\0';
+#if CALC_CACHE_SIZE > 0
+  expressionHash = HashChar(expressionHash, ch);
+#endif
   return 1;
 }
 
 void Calculator_Backspace(void)
 {
-  if (expressionLen > 0)
+  unsigned char i;
+
+  if (expressionLen == 0)
   {
-    expressionLen--;
-    expressionBuffer[expressionLen] = '\0';
+    return;
   }
+
+  // Return to the newest checkpoint, which is at or before the deleted
+  // character, or to the empty expression if it was dropped. Characters
+  // whose checkpoint was dropped in streaming mode can no longer be deleted.
+  i = PopCheckpoint();
+  if (i == 0xFF)
+  {
+    if (expressionTruncated)
+    {
+      return;
+    }
+    ResetParser();
+    i = 0;
+  }
+
+  expressionLen--;
+#if CALC_CACHE_SIZE > 0
+  expressionHash = UnhashChar(expressionHash, expressionBuffer[expressionLen]);
+#endif
+  expressionBuffer[expressionLen] = '\0';
+
+  // Replay the characters between the checkpoint and the deleted one
+  for (; i < expressionLen; i++)
+  {
+    ConsumeChar(expressionBuffer[i], i);
+  }
+  UpdatePreview();
+  ExpressionChanged();
 }
 
 void Calculator_Clear(void)
 {
   expressionLen = 0;
   expressionBuffer[0] = '\0';
+  expressionBase = 0;
+  expressionTruncated = 0;
+  ResetParser();
+  ExpressionChanged();
+#if CALC_CACHE_SIZE > 0
+  expressionHash = 0;
+#endif
 }
 
 char *Calculator_GetExpression(void)
@@ -566,91 +880,104 @@ char *Calculator_GetExpression(void)
   return expressionBuffer;
 }
 
-void Calculator_GetDisplayWindow(char *buffer, unsigned char offset)
+unsigned char Calculator_GetMaxScrollOffset(void)
 {
-  unsigned char i;
-  unsigned char copyLen;
-
-  // Validate offset
-  if (offset > expressionLen)
-  {
-    offset = 0;
-  }
-
-  // Calculate how many characters to copy
-  copyLen = expressionLen - offset;
-  if (copyLen > LCD_DISPLAY_WIDTH)
-  {
-    copyLen = LCD_DISPLAY_WIDTH;
-  }
-
-  // Copy the window
-  for (i = 0; i < copyLen; i++)
-  {
-    buffer[i] = expressionBuffer[offset + i];
-  }
-
-  // Fill remaining with spaces
-  for (; i < LCD_DISPLAY_WIDTH; i++)
+  if (expressionLen <= LCD_DISPLAY_WIDTH)
   {
-    buffer[i] = ' ';
+    return 0;
   }
-
-  buffer[LCD_DISPLAY_WIDTH] = '\0';
+  return expressionLen - LCD_DISPLAY_WIDTH;
 }
 
-unsigned char Calculator_GetMaxScrollOffset(void)
+unsigned char Calculator_GetPreview(char *result)
 {
-  if (expressionLen <= LCD_DISPLAY_WIDTH)
+  if (IsExpressionEmpty() || previewError != CALC_OK)
   {
     return 0;
   }
-  return expressionLen - LCD_DISPLAY_WIDTH;
+
+  PROFILE_BEGIN(PROFILE_FORMAT);
+  Number_ToString(previewValue, result);
+  PROFILE_END(PROFILE_FORMAT);
+  return 1;
 }
 
-unsigned char Calculator_Evaluate(char *result)
+/**
+ * Format resultValue/resultError into resultText
+ */
+static void FormatResult(void)
 {
-  unsigned char errCode;
-  float finalResult;
-
-  // Empty expression
-  if (expressionLen == 0)
+  if (IsExpressionEmpty())
   {
-    strcpy(result, "");
-    return CALC_OK;
+    strcpy(resultText, "");
   }
-
-  // Lexical analysis
-  errCode = Tokenize();
-  if (errCode != CALC_OK)
+  else if (resultError == CALC_ERR_DIV_ZERO)
   {
-    strcpy(result, "Syntax error");
-    return errCode;
+    strcpy(resultText, "Div by zero");
   }
-
-  // Shunting Yard algorithm (Infix to RPN)
-  errCode = ShuntingYard();
-  if (errCode != CALC_OK)
+  else if (resultError == CALC_ERR_OVERFLOW)
   {
-    strcpy(result, "Syntax error");
-    return errCode;
+    strcpy(resultText, "Overflow");
   }
+  else if (resultError != CALC_OK)
+  {
+    strcpy(resultText, "Syntax error");
+  }
+  else
+  {
+    PROFILE_BEGIN(PROFILE_FORMAT);
+    Number_ToString(resultValue, resultText);
+    PROFILE_END(PROFILE_FORMAT);
+  }
+}
 
-  // RPN evaluation
-  errCode = EvaluateRPN(&finalResult);
-  if (errCode == CALC_ERR_DIV_ZERO)
+unsigned char Calculator_Evaluate(char *result)
+{
+  if (evaluatedGeneration == expressionGeneration)
   {
-    strcpy(result, "Div by zero");
-    return errCode;
+#if CALC_REPEAT_EQUALS
+    // Repeated '=': apply the last operator and operand to the previous
+    // result again, like a desk calculator
+    if (!IsExpressionEmpty() && resultError == CALC_OK && repeatOp != NO_OPERATOR)
+    {
+      resultError = PerformOperation(repeatOp, resultValue, repeatOperand, &resultValue);
+      FormatResult();
+    }
+#endif
   }
-  else if (errCode != CALC_OK)
+  else
   {
-    strcpy(result, "Syntax error");
-    return errCode;
+    // The expression was already evaluated while it was typed
+    evaluatedGeneration = expressionGeneration;
+    resultValue = previewValue;
+    resultError = IsExpressionEmpty() ? CALC_OK : previewError;
+#if CALC_CACHE_SIZE > 0
+    // Recently evaluated expressions skip formatting the result
+    // (a truncated expression cannot be compared with the cached ones)
+    if (expressionLen == 0 || expressionTruncated || !CacheLookup())
+    {
+      FormatResult();
+      if (expressionLen > 0 && !expressionTruncated)
+      {
+        CacheInsert();
+      }
+    }
+#else
+    FormatResult();
+#endif
   }
 
-  // Format result (5 decimal places)
-  FloatToString(finalResult, result);
+  strcpy(result, resultText);
+  return resultError;
+}
 
-  return CALC_OK;
+void Calculator_GetCacheStats(unsigned int *hits, unsigned int *misses)
+{
+#if CALC_CACHE_SIZE > 0
+  *hits = cacheHits;
+  *misses = cacheMisses;
+#else
+  *hits = 0;
+  *misses = 0;
+#endif
 }
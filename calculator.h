@@ -4,11 +4,48 @@
 #include "token.h"
 
 // Maximum expression length (32 characters with scrolling display)
+// In streaming mode: number of trailing characters kept for display and
+// backspace. Must be a power of two.
 #define MAX_EXPR_LEN 32
 
+// Streaming mode: expressions may be longer than MAX_EXPR_LEN. Characters
+// are evaluated as they arrive and only the last MAX_EXPR_LEN are kept, so
+// memory use depends on the nesting depth only (see STACK_ARENA_SIZE).
+// Older characters can no longer be seen or deleted.
+#ifndef CALC_STREAMING
+#define CALC_STREAMING 0
+#endif
+
+// Number of parser checkpoints kept for backspace (7 bytes of XRAM each).
+// One is saved before every character that starts a token; digits that
+// continue a number need none. When the ring is full the oldest is
+// dropped, and deleting back past the remaining ones replays the
+// expression from its start (in streaming mode those characters can no
+// longer be deleted). Must be a power of two.
+#ifndef CALC_CHECKPOINTS
+#define CALC_CHECKPOINTS 16
+#endif
+
 // LCD display window size
 #define LCD_DISPLAY_WIDTH 16
 
+// Repeated '=' without editing the expression applies the last operator
+// and operand again to the previous result (like a desk calculator).
+// That is the operator the end of the expression applies last, so an
+// expression closed by a parenthesis, such as "(2+3)", has nothing to
+// repeat. Set to 0 to only show the cached result again.
+#ifndef CALC_REPEAT_EQUALS
+#define CALC_REPEAT_EQUALS 1
+#endif
+
+// Number of recently evaluated expressions whose formatted results are
+// kept (LRU, 54 bytes of XRAM each). 0 (default) disables the cache; it
+// only pays off when the same expressions are evaluated again (see the
+// repeats argument of host/bench).
+#ifndef CALC_CACHE_SIZE
+#define CALC_CACHE_SIZE 0
+#endif
+
 // Error codes
 #define CALC_OK 0
 #define CALC_ERR_SYNTAX 1
@@ -24,6 +61,7 @@ void Calculator_Init(void);
 
 /**
  * Add a character to the expression
+ * In streaming mode a full buffer drops its oldest character instead
  * @param ch Input character
  * @return 1=success, 0=failure (buffer full or invalid character)
  */
@@ -31,6 +69,8 @@ unsigned char Calculator_InputChar(char ch);
 
 /**
  * Delete the last character in the expression (backspace)
+ * In streaming mode characters that were dropped, or whose parser state was
+ * dropped, are not deleted
  */
 void Calculator_Backspace(void);
 
@@ -45,24 +85,33 @@ void Calculator_Clear(void);
  */
 char *Calculator_GetExpression(void);
 
-/**
- * Get a window of the expression for LCD display (16 characters)
- * @param buffer Buffer to store the display window (at least 17 bytes)
- * @param offset Offset position in the expression (0 to MAX_EXPR_LEN-LCD_DISPLAY_WIDTH)
- */
-void Calculator_GetDisplayWindow(char *buffer, unsigned char offset);
-
 /**
  * Get the maximum scroll offset for current expression
  * @return Maximum offset (0 if expression <= 16 chars)
  */
 unsigned char Calculator_GetMaxScrollOffset(void);
 
+/**
+ * Get a preview of the result while the expression is being typed
+ * @param result Result string buffer (at least 17 bytes, including \0)
+ * @return 1=result written, 0=expression is empty or not (yet) valid
+ */
+unsigned char Calculator_GetPreview(char *result);
+
 /**
  * Evaluate the expression result
+ * Pressing '=' again without changing the expression reuses the cached
+ * result (see CALC_REPEAT_EQUALS)
  * @param result Result string buffer (at least 17 bytes, including \0)
  * @return Error code (CALC_OK, CALC_ERR_SYNTAX, etc.)
  */
 unsigned char Calculator_Evaluate(char *result);
 
+/**
+ * Get the result cache statistics
+ * @param hits Pointer to store the number of cache hits
+ * @param misses Pointer to store the number of cache misses
+ */
+void Calculator_GetCacheStats(unsigned int *hits, unsigned int *misses);
+
 #endif // CALCULATOR_H
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// ==================== Clock Configuration ====================
+// Everything that depends on the clock (system tick, delays) is derived
+// from these two settings.
+
+// Oscillator frequency in Hz (must match CLOCK in the project settings)
+#ifndef F_OSC
+#define F_OSC 24000000UL
+#endif
+
+// Oscillator clocks per machine cycle: 12 for the standard 12T core, or 6
+// for chips running in 6T (X2) mode, which is selected by the chip's X2
+// fuse or CKCON register. The timers are assumed to run at the same rate.
+#ifndef CLOCK_MODE
+#define CLOCK_MODE 12
+#endif
+
+// Machine cycles (and timer counts) per second and per microsecond
+#define F_CYCLE (F_OSC / CLOCK_MODE)
+#define CYCLES_PER_US (F_CYCLE / 1000000UL)
+
+#endif // CONFIG_H
@@ -1,49 +1,23 @@
-#include <intrins.h> /* for _nop_() */
+#include "delay.h"
+#include "timer.h"
 
-static void delay10us(void) //@12.000MHz
+// Busy loop of DELAY_LOOP_OVERHEAD + 2 * count machine cycles
+// C51 compiles the loop to a single DJNZ on the parameter register
+void delayLoop(unsigned char count)
 {
-  unsigned char data i;
-
-  _nop_();
-  i = 2;
-  while (--i)
+  while (--count)
     ;
 }
 
-static void delay100us(void) //@12.000MHz
+// Wait for the system tick: the first tick may come right away, so one
+// extra tick guarantees the full time
+void delayMiliseconds(unsigned int miliseconds)
 {
-  unsigned char data i;
+  unsigned int start;
+  unsigned int ticks;
 
-  _nop_();
-  i = 47;
-  while (--i)
+  start = Timer_GetTicks();
+  ticks = (miliseconds + TICK_MS - 1) / TICK_MS + 1;
+  while (Timer_GetTicks() - start < ticks)
     ;
 }
-
-// 微秒级延时函数
-void delayMicroseconds(unsigned int microseconds)
-{
-  unsigned int count;
-
-  // 每10微秒调用一次delay10us
-  count = microseconds / 10;
-  while (count--)
-  {
-    delay10us();
-  }
-}
-
-// Call delay100us 10 times to make 1 millisecond
-void delayMiliseconds(unsigned long miliseconds)
-{
-  // i is a counter for 100us delay
-  unsigned char i;
-
-  while (miliseconds--)
-  {
-    for (i = 0; i < 10; i++)
-    {
-      delay100us();
-    }
-  }
-}
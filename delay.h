@@ -1,7 +1,45 @@
 #ifndef DELAY_H
 #define DELAY_H
 
-void delayMiliseconds(unsigned long miliseconds);
-void delayMicroseconds(unsigned int microseconds);
+#include "config.h"
 
-#endif
\ No newline at end of file
+// Cycles taken by delayLoop(count): DELAY_LOOP_OVERHEAD + 2 * count
+// (MOV R7 + LCALL + RET around a DJNZ loop)
+#define DELAY_LOOP_OVERHEAD 5
+
+// Machine cycles in us microseconds, rounded up (F_CYCLE need not be a
+// whole number of MHz, e.g. 11.0592 MHz)
+#define DELAY_US_CYCLES(us) (((us) * F_CYCLE + 999999UL) / 1000000UL)
+
+// delayLoop count for a wait of at least us microseconds
+#define DELAY_US_LOOPS(us)                                           \
+  (DELAY_US_CYCLES(us) > DELAY_LOOP_OVERHEAD + 2                     \
+       ? (DELAY_US_CYCLES(us) - DELAY_LOOP_OVERHEAD + 1) / 2         \
+       : 1)
+
+// Compile-time check that a wait fits in one delayLoop: the array size
+// is negative, and the build fails, if the count exceeds 255
+#define DELAY_US_CHECK(us) ((void)sizeof(char[DELAY_US_LOOPS(us) <= 255 ? 1 : -1]))
+
+/**
+ * Wait at least the given number of microseconds (busy loop)
+ * microseconds must be a constant, so the loop count is computed at
+ * compile time. At most 128 us in 6T mode, 256 us in 12T mode at 24 MHz;
+ * longer waits do not compile.
+ */
+#define delayMicroseconds(microseconds) \
+  delayLoop((DELAY_US_CHECK(microseconds), DELAY_US_LOOPS(microseconds)))
+
+/**
+ * Busy loop of DELAY_LOOP_OVERHEAD + 2 * count machine cycles
+ * @param count Loop count (1-255)
+ */
+void delayLoop(unsigned char count);
+
+/**
+ * Wait at least the given number of milliseconds (system tick, so the
+ * tick must be running, see Timer_Init)
+ */
+void delayMiliseconds(unsigned int miliseconds);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef HAL_H
+#define HAL_H
+
+// ==================== Compiler Abstraction ====================
+// Every module includes this header instead of <reg52.h>, so the same
+// sources build with Keil C51, with SDCC (see sim/) and, for the
+// calculator core only, with a host compiler (see host/).
+
+// Port SFR addresses (for HAL_SBIT)
+#define HAL_P0 0x80
+#define HAL_P1 0x90
+#define HAL_P2 0xA0
+#define HAL_P3 0xB0
+
+#if defined(__C51__)
+
+// Keil C51: memory space keywords are built in
+#include <reg52.h>
+#include <intrins.h> /* for _nop_() */
+
+// Bit of a bit-addressable SFR
+#define HAL_SBIT(name, sfrAddress, bitNumber) sbit name = (sfrAddress) ^ (bitNumber)
+
+// Interrupt service routine for an interrupt vector number
+#define HAL_ISR(name, vector) void name(void) interrupt vector
+
+#elif defined(__SDCC)
+
+// SDCC: same memory spaces, spelled with underscores
+#include <8052.h>
+
+#define xdata __xdata
+#define idata __idata
+#define pdata __pdata
+#define code __code
+#define reentrant __reentrant
+#define bit __bit
+
+#define _nop_() __asm__("nop")
+
+#define HAL_SBIT(name, sfrAddress, bitNumber) __sbit __at((sfrAddress) + (bitNumber)) name
+
+// SDCC only places a vector for an ISR whose prototype is visible in the
+// file containing main(), so the ISRs are declared in the module headers
+#define HAL_ISR(name, vector) void name(void) __interrupt(vector)
+
+#else
+
+// Host build (GCC/Clang): all memory spaces are plain memory
+#define xdata
+#define idata
+#define pdata
+#define code
+#define reentrant
+#define bit unsigned char
+
+#endif
+
+#endif // HAL_H
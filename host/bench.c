@@ -0,0 +1,204 @@
+// Host benchmark for the calculator core: types each expression of a
+// corpus with Calculator_InputChar, evaluates it with Calculator_Evaluate
+// and reports the time per evaluation and the heap allocations made.
+//
+// Usage: bench [corpus-file [passes [repeats]]]
+// The corpus has one expression per line; a built-in corpus is used if
+// no file (or "-") is given. With repeats > 1 each expression is typed and
+// evaluated that many times in a row, as when a result is checked again
+// (the workload the result cache is for, see CALC_CACHE_SIZE).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calculator.h"
+#include "stack.h"
+
+#define MAX_CORPUS 1024
+#define DEFAULT_PASSES 2000
+
+static const char *defaultCorpus[] = {
+    "1+2",
+    "3+4*2",
+    "(3+4)*2",
+    "-5+3",
+    "1.5*2-0.25",
+    "100/7",
+    "((1+2)*(3+4))/5",
+    "2*(3+(4-1)*2)",
+    "12345.678*9",
+    "1/0",
+    "3+",
+    "(1+2",
+    "0.1+0.2+0.3+0.4",
+    "9*9*9*9*9*9",
+    "1-2-3-4-5-6-7-8",
+    "((((1))))+(((2)))",
+};
+
+static char *corpus[MAX_CORPUS];
+static unsigned int corpusSize = 0;
+
+// ==================== Allocation Counting ====================
+// The Makefile links with --wrap, so every heap allocation goes through
+// these wrappers.
+
+static unsigned long allocCount = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  allocCount++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+  allocCount++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  allocCount++;
+  return __real_realloc(ptr, size);
+}
+
+// ==================== Corpus ====================
+
+/**
+ * Load the corpus from a file, one expression per line
+ * @param path File name
+ * @return 1=success, 0=failure
+ */
+static int LoadCorpus(const char *path)
+{
+  char line[256];
+  FILE *file = fopen(path, "r");
+
+  if (file == NULL)
+  {
+    return 0;
+  }
+
+  while (corpusSize < MAX_CORPUS && fgets(line, sizeof(line), file) != NULL)
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    corpus[corpusSize++] = strdup(line);
+  }
+  fclose(file);
+  return 1;
+}
+
+/**
+ * Type one expression and evaluate it
+ * @param expr Expression
+ * @param result Result buffer (at least 17 bytes)
+ * @return Number of characters typed
+ */
+static unsigned int RunExpression(const char *expr, char *result)
+{
+  unsigned int typed = 0;
+
+  Calculator_Clear();
+  while (*expr != '\0')
+  {
+    if (Calculator_InputChar(*expr))
+    {
+      typed++;
+    }
+    expr++;
+  }
+  Calculator_Evaluate(result);
+  return typed;
+}
+
+static double Now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+  char result[LCD_DISPLAY_WIDTH + 1];
+  unsigned long passes = DEFAULT_PASSES;
+  unsigned long repeats = 1;
+  unsigned long pass, repeat, evals, chars, allocs;
+  unsigned int hits, misses, i;
+  unsigned char checksum = 0;
+  double start, elapsed;
+
+  if (argc > 1 && strcmp(argv[1], "-") != 0)
+  {
+    if (!LoadCorpus(argv[1]))
+    {
+      fprintf(stderr, "bench: cannot read %s\n", argv[1]);
+      return 1;
+    }
+  }
+  else
+  {
+    for (i = 0; i < sizeof(defaultCorpus) / sizeof(defaultCorpus[0]); i++)
+    {
+      corpus[corpusSize++] = (char *)defaultCorpus[i];
+    }
+  }
+  if (argc > 2)
+  {
+    passes = strtoul(argv[2], NULL, 10);
+  }
+  if (argc > 3)
+  {
+    repeats = strtoul(argv[3], NULL, 10);
+  }
+  if (corpusSize == 0 || passes == 0 || repeats == 0)
+  {
+    fprintf(stderr, "bench: nothing to run\n");
+    return 1;
+  }
+
+  Calculator_Init();
+
+  // Warm up, then time whole passes over the corpus
+  for (i = 0; i < corpusSize; i++)
+  {
+    RunExpression(corpus[i], result);
+  }
+
+  chars = 0;
+  allocs = allocCount;
+  start = Now();
+  for (pass = 0; pass < passes; pass++)
+  {
+    for (i = 0; i < corpusSize; i++)
+    {
+      for (repeat = 0; repeat < repeats; repeat++)
+      {
+        chars += RunExpression(corpus[i], result);
+        checksum += (unsigned char)result[0];
+      }
+    }
+  }
+  elapsed = Now() - start;
+  allocs = allocCount - allocs;
+  evals = passes * corpusSize * repeats;
+
+  Calculator_GetCacheStats(&hits, &misses);
+
+  printf("expressions: %u x %lu passes x %lu repeats = %lu evaluations\n", corpusSize, passes, repeats, evals);
+  printf("ns/eval:     %.1f\n", elapsed / evals);
+  printf("ns/char:     %.1f\n", chars ? elapsed / chars : 0.0);
+  printf("allocations: %lu\n", allocs);
+  printf("cache:       %u hits, %u misses\n", hits, misses);
+  printf("stack arena: %u of %u bytes at peak\n", Stack_GetPeakUse(), STACK_ARENA_SIZE);
+  printf("checksum:    %u\n", checksum);
+  return 0;
+}
@@ -0,0 +1,995 @@
+// Differential fuzzer for the calculator core: generates random valid and
+// invalid expressions over the keypad alphabet, types them with
+// Calculator_InputChar (with the occasional typo fixed by
+// Calculator_Backspace, or the rest of the expression typed ahead and
+// deleted again), evaluates them with Calculator_Evaluate and
+// compares the error code and the formatted result with a double
+// precision reference evaluator.
+//
+// Usage: fuzz [count [seed]]
+//
+// The reference follows the acceptance rules of ParseChar in calculator.c
+// (a '-' after an operator or '(' starts a number, operators are applied
+// from the operand stack, the first evaluation error wins, an operator or
+// operand that does not fit in the stack arena is an overflow) and
+// computes the value the backend must hold exactly, from the rules of the
+// backend rather than its code:
+//   fixed point  literals rounded half up on the first dropped digit,
+//                sums exact, products and quotients rounded half away
+//                from zero, all in 64-bit integers
+//   float        every operation rounded to the nearest float (done in
+//                double, which is exact for one float operation)
+// Float literals are taken from the backend's parser, and each one is
+// checked against the correctly rounded value of its decimal text within
+// the error its digit-by-digit accumulation may make. Division by zero
+// and the range limits are therefore decided exactly and no case is left
+// out. A result diverges if its error code differs, or if it is off the
+// reference by more than one unit in the last place (ulp or last fixed
+// point place) plus the rounding of the printed digits.
+//
+// Exits with status 1 if any case diverges.
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "calculator.h"
+#include "number.h"
+#include "stack.h"
+
+#define DEFAULT_COUNT 100000UL
+#define BATCH_SIZE 4096
+#define MAX_EXAMPLES 10
+
+// Alphabet of the keypad
+static const char alphabet[] = "0123456789.+-*/()";
+#define ALPHABET_SIZE (sizeof(alphabet) - 1)
+
+// Operator mix: bit i is set if operator opSymbols[i] was applied
+#define MIX_COUNT 16
+
+#if NUMBER_BACKEND == NUMBER_BACKEND_FIXED
+#define RESULT_DECIMALS NUMBER_FRAC_DIGITS
+#define ERROR_UNIT "last place"
+#else
+#define RESULT_DECIMALS 5
+#define ERROR_UNIT "ulp"
+#endif
+
+// Slack for converting the reference and the printed result to double
+#define REF_SLACK 1e-9
+
+// ==================== Random Numbers ====================
+// Own generator so a seed gives the same cases on every C library
+
+static unsigned long rngState = 1;
+
+static unsigned long Random(void)
+{
+  rngState ^= (rngState << 13) & 0xFFFFFFFFUL;
+  rngState ^= rngState >> 17;
+  rngState ^= (rngState << 5) & 0xFFFFFFFFUL;
+  return rngState;
+}
+
+/**
+ * Random number below a limit
+ * @param limit Upper limit (exclusive, > 0)
+ */
+static unsigned int RandomBelow(unsigned int limit)
+{
+  return (unsigned int)(Random() % limit);
+}
+
+// ==================== Reference Evaluator ====================
+
+// Reference value: exactly the value the backend must hold
+typedef struct
+{
+#if NUMBER_BACKEND == NUMBER_BACKEND_FIXED
+  long long raw; // Value scaled by NUMBER_SCALE
+#else
+  float value;
+#endif
+} RefNumber;
+
+// Outcome predicted by the reference
+typedef struct
+{
+  unsigned char error;    // Expected CALC_* code
+  unsigned char mix;      // Operator mix
+  unsigned char capacity; // 1 if the operand/operator stacks ran full
+  unsigned char literal;  // 1 if the backend parsed a literal out of bounds
+  RefNumber result;
+} RefResult;
+
+#define REF_LPAREN 0xFF
+#define REF_STACK_SIZE 64
+
+static struct
+{
+  RefNumber numbers[REF_STACK_SIZE];
+  unsigned char numberTop;
+  unsigned char ops[REF_STACK_SIZE];
+  unsigned char opTop;
+  unsigned char parenCount;
+  unsigned char lastToken;
+  unsigned char syntaxError;
+  unsigned char evalError;
+  unsigned char inNumber;
+  unsigned char hasDot;
+  unsigned char negative;
+  char digits[MAX_EXPR_LEN + 1];
+  unsigned char digitLen;
+  RefResult *out;
+} ref;
+
+// Stack arena of stack.c: operators take one byte each from the bottom,
+// operands sizeof(Number) each from the top
+#define ARENA_SLOTS ((int)(STACK_ARENA_SIZE / sizeof(Number)))
+#define ARENA_BOTTOM() ((ARENA_SLOTS - ref.numberTop) * (int)sizeof(Number))
+
+static const char opSymbols[] = "+-*/";
+
+static unsigned char Precedence(unsigned char op)
+{
+  return op >= 2 ? 2 : 1;
+}
+
+#if NUMBER_BACKEND == NUMBER_BACKEND_FIXED
+
+static double RefToDouble(const RefNumber *number)
+{
+  return (double)number->raw / NUMBER_SCALE;
+}
+
+/**
+ * Unit in the last place of a result
+ */
+static double ResultUnit(double value)
+{
+  (void)value;
+  return 1.0 / NUMBER_SCALE;
+}
+
+/**
+ * Build the current number from its typed digits
+ * Digits beyond NUMBER_FRAC_DIGITS round half up on the first of them,
+ * and a non-zero number that rounds to zero is out of range
+ * @param number Pointer to store the value
+ * @return 1=success, 0=failure (value out of range)
+ */
+static unsigned char RefBuildNumber(RefNumber *number)
+{
+  unsigned long long raw = 0;
+  long weight = NUMBER_SCALE / 10;
+  unsigned char i, digit, afterDot = 0, fracDigits = 0, inexact = 0;
+
+  for (i = 0; i < ref.digitLen; i++)
+  {
+    digit = ref.digits[i] - '0';
+    if (ref.digits[i] == '.')
+    {
+      afterDot = 1;
+    }
+    else if (!afterDot)
+    {
+      raw = raw * 10 + digit * NUMBER_SCALE;
+      if (raw > NUMBER_MAX)
+      {
+        return 0;
+      }
+    }
+    else if (fracDigits++ < NUMBER_FRAC_DIGITS)
+    {
+      raw += digit * weight;
+      weight /= 10;
+    }
+    else
+    {
+      raw += fracDigits == NUMBER_FRAC_DIGITS + 1 && digit >= 5;
+      inexact |= digit != 0;
+    }
+  }
+  if (raw > NUMBER_MAX || (raw == 0 && inexact))
+  {
+    return 0;
+  }
+
+  number->raw = ref.negative ? -(long long)raw : (long long)raw;
+  return 1;
+}
+
+/**
+ * Apply an operator the way the fixed point backend must
+ * @return CALC_OK, CALC_ERR_DIV_ZERO or CALC_ERR_OVERFLOW
+ */
+static unsigned char RefOperate(unsigned char op, const RefNumber *a, const RefNumber *b, RefNumber *r)
+{
+  unsigned long long x = llabs(a->raw);
+  unsigned long long y = llabs(b->raw);
+  unsigned long long q, rem;
+  unsigned char negative = (a->raw < 0) != (b->raw < 0);
+
+  switch (opSymbols[op])
+  {
+  case '+':
+    r->raw = a->raw + b->raw;
+    break;
+  case '-':
+    r->raw = a->raw - b->raw;
+    break;
+  case '*':
+    // Rounded half away from zero on the first removed digit
+    q = x * y / NUMBER_SCALE + (x * y % NUMBER_SCALE >= NUMBER_SCALE / 2);
+    r->raw = negative ? -(long long)q : (long long)q;
+    break;
+  default:
+    if (y == 0)
+    {
+      return CALC_ERR_DIV_ZERO;
+    }
+    // Rounded half away from zero
+    q = x * NUMBER_SCALE / y;
+    rem = x * NUMBER_SCALE % y;
+    q += rem >= y - rem;
+    r->raw = negative ? -(long long)q : (long long)q;
+    break;
+  }
+
+  return llabs(r->raw) > NUMBER_MAX ? CALC_ERR_OVERFLOW : CALC_OK;
+}
+
+#else
+
+// Worst literal parse error seen (ulp of the correctly rounded value)
+static double literalErrorMax = 0;
+
+/**
+ * Unit in the last place of a float near a value
+ */
+static double Ulp32(double value)
+{
+  int exponent;
+
+  frexp(fabs(value), &exponent);
+  return ldexp(1.0, exponent - 24 < -149 ? -149 : exponent - 24);
+}
+
+static double RefToDouble(const RefNumber *number)
+{
+  return number->value;
+}
+
+static double ResultUnit(double value)
+{
+  return Ulp32(value);
+}
+
+/**
+ * Build the current number with the backend's parser, and check it
+ * against the correctly rounded value of the typed digits
+ * Each digit is accumulated with one float rounding, so the parse may be
+ * off by up to (digits + 1) ulp; integers below 2^24 are exact
+ * @param number Pointer to store the value
+ * @return 1=success, 0=failure (value out of range)
+ */
+static unsigned char RefBuildNumber(RefNumber *number)
+{
+  NumberBuilder builder;
+  Number value;
+  unsigned char i, afterDot = 0, fracDigits = 0, nonzero = 0;
+  double exact, bound = 0, error;
+
+  Number_BuildBegin(&builder);
+  for (i = 0; i < ref.digitLen; i++)
+  {
+    if (ref.digits[i] == '.')
+    {
+      afterDot = 1;
+      continue;
+    }
+    nonzero |= ref.digits[i] != '0';
+    fracDigits += afterDot;
+    Number_BuildDigit(&builder, ref.digits[i] - '0', afterDot);
+  }
+  if (!Number_BuildEnd(&builder, ref.negative, &value))
+  {
+    return 0;
+  }
+
+  ref.digits[ref.digitLen] = '\0';
+  exact = ref.digitLen ? strtod(ref.digits, NULL) : 0.0;
+  if (nonzero && (fracDigits > 0 || exact >= 16777216.0))
+  {
+    bound = (ref.digitLen + 1) * Ulp32(exact > 1 ? exact : 1);
+  }
+  error = fabs(fabs(value) - exact);
+  if (error > bound + REF_SLACK * exact)
+  {
+    ref.out->literal = 1;
+  }
+  if (exact > 0 && error / Ulp32(exact) > literalErrorMax)
+  {
+    literalErrorMax = error / Ulp32(exact);
+  }
+
+  number->value = value;
+  return 1;
+}
+
+/**
+ * Apply an operator the way the float backend must (IEEE single
+ * precision, rounded to nearest)
+ * @return CALC_OK, CALC_ERR_DIV_ZERO or CALC_ERR_OVERFLOW
+ */
+static unsigned char RefOperate(unsigned char op, const RefNumber *a, const RefNumber *b, RefNumber *r)
+{
+  double x = a->value;
+  double y = b->value;
+
+  switch (opSymbols[op])
+  {
+  case '+':
+    r->value = (float)(x + y);
+    break;
+  case '-':
+    r->value = (float)(x - y);
+    break;
+  case '*':
+    r->value = (float)(x * y);
+    break;
+  default:
+    if (y == 0)
+    {
+      return CALC_ERR_DIV_ZERO;
+    }
+    r->value = (float)(x / y);
+    break;
+  }
+
+  return isinf(r->value) ? CALC_ERR_OVERFLOW : CALC_OK;
+}
+
+#endif
+
+static void RefPushOperand(RefNumber number)
+{
+  if (ref.evalError != CALC_OK)
+  {
+    return;
+  }
+
+  if (ref.numberTop >= ARENA_SLOTS || ref.opTop > ARENA_BOTTOM() - (int)sizeof(Number))
+  {
+    ref.out->capacity = 1;
+    ref.evalError = CALC_ERR_OVERFLOW;
+    return;
+  }
+  ref.numbers[ref.numberTop++] = number;
+}
+
+static void RefPushOp(unsigned char op)
+{
+  if (ref.opTop >= ARENA_BOTTOM())
+  {
+    ref.out->capacity = 1;
+    if (ref.evalError == CALC_OK)
+    {
+      ref.evalError = CALC_ERR_OVERFLOW;
+    }
+    return;
+  }
+  ref.ops[ref.opTop++] = op;
+}
+
+static void RefApply(unsigned char op)
+{
+  RefNumber a, b, r;
+  unsigned char error;
+
+  if (ref.evalError != CALC_OK)
+  {
+    return;
+  }
+  if (ref.numberTop < 2)
+  {
+    ref.evalError = CALC_ERR_SYNTAX;
+    return;
+  }
+  b = ref.numbers[--ref.numberTop];
+  a = ref.numbers[--ref.numberTop];
+  ref.out->mix |= 1 << op;
+
+  error = RefOperate(op, &a, &b, &r);
+  if (error != CALC_OK)
+  {
+    ref.evalError = error;
+    return;
+  }
+  ref.numbers[ref.numberTop++] = r;
+}
+
+static void RefEndNumber(void)
+{
+  RefNumber number;
+
+  ref.inNumber = 0;
+  ref.lastToken = TOKEN_NUMBER;
+  if (!RefBuildNumber(&number))
+  {
+    if (ref.evalError == CALC_OK)
+    {
+      ref.evalError = CALC_ERR_OVERFLOW;
+    }
+    return;
+  }
+  RefPushOperand(number);
+}
+
+static void RefChar(char ch)
+{
+  const char *symbol;
+  unsigned char op;
+
+  if (ref.syntaxError)
+  {
+    return;
+  }
+
+  if (ref.inNumber)
+  {
+    if ((ch >= '0' && ch <= '9') || ch == '.')
+    {
+      if (ch == '.' && ref.hasDot)
+      {
+        ref.syntaxError = 1;
+        return;
+      }
+      ref.hasDot |= ch == '.';
+      ref.digits[ref.digitLen++] = ch;
+      return;
+    }
+    RefEndNumber();
+  }
+
+  if ((ch >= '0' && ch <= '9') || ch == '.' ||
+      (ch == '-' && (ref.lastToken == TOKEN_OPERATOR || ref.lastToken == TOKEN_LPAREN)))
+  {
+    ref.inNumber = 1;
+    ref.negative = ch == '-';
+    ref.hasDot = ch == '.';
+    ref.digitLen = 0;
+    if (ch != '-')
+    {
+      ref.digits[ref.digitLen++] = ch;
+    }
+    return;
+  }
+
+  symbol = strchr(opSymbols, ch);
+  if (symbol != NULL)
+  {
+    op = (unsigned char)(symbol - opSymbols);
+    while (ref.opTop > 0 && ref.ops[ref.opTop - 1] != REF_LPAREN &&
+           Precedence(ref.ops[ref.opTop - 1]) >= Precedence(op))
+    {
+      RefApply(ref.ops[--ref.opTop]);
+    }
+    RefPushOp(op);
+    ref.lastToken = TOKEN_OPERATOR;
+    return;
+  }
+
+  if (ch == '(')
+  {
+    RefPushOp(REF_LPAREN);
+    ref.parenCount++;
+    ref.lastToken = TOKEN_LPAREN;
+    return;
+  }
+
+  if (ref.parenCount == 0)
+  {
+    ref.syntaxError = 1;
+    return;
+  }
+  // The parenthesis is matched by count: after an overflow its '(' may
+  // not be on the stack
+  while (ref.opTop > 0)
+  {
+    op = ref.ops[--ref.opTop];
+    if (op == REF_LPAREN)
+    {
+      break;
+    }
+    RefApply(op);
+  }
+  ref.parenCount--;
+  ref.lastToken = TOKEN_RPAREN;
+}
+
+/**
+ * Evaluate an expression with the reference
+ * @param expr Expression
+ * @param out Predicted outcome
+ */
+static void RefEvaluate(const char *expr, RefResult *out)
+{
+  memset(&ref, 0, sizeof(ref));
+  memset(out, 0, sizeof(*out));
+  ref.out = out;
+  ref.lastToken = TOKEN_OPERATOR;
+
+  while (*expr != '\0')
+  {
+    RefChar(*expr++);
+  }
+
+  if (ref.inNumber)
+  {
+    RefEndNumber();
+  }
+  if (ref.syntaxError)
+  {
+    out->error = CALC_ERR_SYNTAX;
+    return;
+  }
+  if (ref.parenCount != 0)
+  {
+    out->error = CALC_ERR_SYNTAX;
+    return;
+  }
+  while (ref.opTop > 0)
+  {
+    RefApply(ref.ops[--ref.opTop]);
+  }
+  if (ref.evalError != CALC_OK)
+  {
+    out->error = ref.evalError;
+  }
+  else if (ref.numberTop != 1)
+  {
+    out->error = CALC_ERR_SYNTAX;
+  }
+  else
+  {
+    out->result = ref.numbers[0];
+  }
+}
+
+// ==================== Expression Generator ====================
+
+static char genBuffer[MAX_EXPR_LEN + 1];
+static unsigned char genLen;
+
+static unsigned char Emit(char ch)
+{
+  if (genLen >= MAX_EXPR_LEN)
+  {
+    return 0;
+  }
+  genBuffer[genLen++] = ch;
+  return 1;
+}
+
+/**
+ * Generate a number: optional sign, integer digits, optional decimals
+ * Now and then the number is long enough to reach the range limits,
+ * or empty ("-", ".")
+ */
+static unsigned char GenNumber(void)
+{
+  unsigned char intDigits, fracDigits, i;
+  unsigned char negative = RandomBelow(6) == 0;
+  unsigned char ok = 1;
+
+  if (negative)
+  {
+    ok &= Emit('-');
+  }
+
+  intDigits = RandomBelow(8) == 0 ? 6 + RandomBelow(8) : RandomBelow(4);
+  fracDigits = RandomBelow(3) == 0 ? 1 + RandomBelow(7) : 0;
+  if (intDigits == 0 && fracDigits == 0 && RandomBelow(8) != 0)
+  {
+    intDigits = 1;
+  }
+
+  for (i = 0; i < intDigits; i++)
+  {
+    ok &= Emit('0' + (i == 0 && intDigits > 1 ? 1 + RandomBelow(9) : RandomBelow(10)));
+  }
+  if (fracDigits > 0 || (intDigits == 0 && (!negative || RandomBelow(2))))
+  {
+    ok &= Emit('.');
+  }
+  for (i = 0; i < fracDigits; i++)
+  {
+    ok &= Emit('0' + RandomBelow(10));
+  }
+  return ok;
+}
+
+static unsigned char GenExpr(unsigned char depth);
+
+static unsigned char GenTerm(unsigned char depth)
+{
+  if (depth < 5 && RandomBelow(4) == 0)
+  {
+    return Emit('(') && GenExpr(depth + 1) && Emit(')');
+  }
+  return GenNumber();
+}
+
+static unsigned char GenExpr(unsigned char depth)
+{
+  if (!GenTerm(depth))
+  {
+    return 0;
+  }
+  while (RandomBelow(depth == 0 ? 4 : 3) != 0)
+  {
+    if (!Emit(opSymbols[RandomBelow(4)]) || !GenTerm(depth))
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * Generate a deeply nested expression with one-digit operands, which fills
+ * the stack arena within MAX_EXPR_LEN characters
+ * Each level is "d op (" or, for an operator chain, "d op d op (" with the
+ * second operator binding tighter, so both operators stay pending
+ * @param chain 1 for operator chains, 0 for one operator per level
+ */
+static unsigned char GenNested(unsigned char chain)
+{
+  unsigned char depth = 4 + RandomBelow(chain ? 3 : 6);
+  unsigned char i;
+  unsigned char ok = 1;
+
+  for (i = 0; i < depth; i++)
+  {
+    ok &= Emit('1' + RandomBelow(9));
+    if (chain)
+    {
+      ok &= Emit(opSymbols[RandomBelow(2)]);
+      ok &= Emit('1' + RandomBelow(9));
+      ok &= Emit(opSymbols[2 + RandomBelow(2)]);
+    }
+    else
+    {
+      ok &= Emit(opSymbols[RandomBelow(4)]);
+    }
+    ok &= Emit('(');
+  }
+  ok &= Emit('1' + RandomBelow(9));
+  for (i = 0; i < depth; i++)
+  {
+    ok &= Emit(')');
+  }
+  return ok;
+}
+
+/**
+ * Generate the next expression into genBuffer
+ * Mostly grammatical expressions, some of them mutated, some nested deep
+ * enough to fill the stack arena, and some random strings over the
+ * alphabet
+ */
+static void Generate(void)
+{
+  unsigned int kind = RandomBelow(10);
+  unsigned char edits, pos;
+
+  if (kind < 2)
+  {
+    genLen = 1 + RandomBelow(MAX_EXPR_LEN);
+    for (pos = 0; pos < genLen; pos++)
+    {
+      // Digits twice as likely as the other keys
+      genBuffer[pos] = alphabet[RandomBelow(ALPHABET_SIZE + 10) % ALPHABET_SIZE];
+    }
+    genBuffer[genLen] = '\0';
+    return;
+  }
+
+  do
+  {
+    genLen = 0;
+  } while (kind >= 8 ? !GenNested(kind == 9) : !GenExpr(0));
+
+  // Mutations: delete, replace or insert a character
+  if (kind < 4)
+  {
+    for (edits = 1 + RandomBelow(2); edits > 0; edits--)
+    {
+      pos = RandomBelow(genLen);
+      switch (RandomBelow(3))
+      {
+      case 0:
+        if (genLen > 1)
+        {
+          memmove(genBuffer + pos, genBuffer + pos + 1, genLen - pos - 1);
+          genLen--;
+        }
+        break;
+      case 1:
+        genBuffer[pos] = alphabet[RandomBelow(ALPHABET_SIZE)];
+        break;
+      default:
+        if (genLen < MAX_EXPR_LEN)
+        {
+          memmove(genBuffer + pos + 1, genBuffer + pos, genLen - pos);
+          genBuffer[pos] = alphabet[RandomBelow(ALPHABET_SIZE)];
+          genLen++;
+        }
+        break;
+      }
+    }
+  }
+  genBuffer[genLen] = '\0';
+}
+
+// ==================== Comparison ====================
+
+typedef struct
+{
+  char expr[MAX_EXPR_LEN + 1];
+  char typos[MAX_EXPR_LEN]; // Key typed and deleted before each character (0 = none)
+  unsigned char rewind;     // Position before which the rest is typed and deleted (0xFF = none)
+  unsigned char error;
+  char text[LCD_DISPLAY_WIDTH + 1];
+} Case;
+
+static Case cases[BATCH_SIZE];
+
+// Statistics per operator mix: error beyond the rounding of the printed
+// digits, in units of the backend (ulp or last fixed point place)
+static struct
+{
+  unsigned long compared;
+  double errorSum;
+  double errorMax;
+} mixStats[MIX_COUNT];
+
+static unsigned long expectedErrors[4];
+static unsigned long capacityHits = 0;
+static unsigned long divergences = 0;
+
+/**
+ * Type one case and evaluate it
+ */
+static void RunCase(Case *item)
+{
+  unsigned char i, j, typed;
+
+  Calculator_Clear();
+  for (i = 0; item->expr[i] != '\0'; i++)
+  {
+    if (i == item->rewind)
+    {
+      typed = 0;
+      for (j = i; item->expr[j] != '\0'; j++)
+      {
+        typed += Calculator_InputChar(item->expr[j]);
+      }
+      while (typed-- > 0)
+      {
+        Calculator_Backspace();
+      }
+    }
+    if (item->typos[i] != 0 && Calculator_InputChar(item->typos[i]))
+    {
+      Calculator_Backspace();
+    }
+    Calculator_InputChar(item->expr[i]);
+  }
+  item->error = Calculator_Evaluate(item->text);
+}
+
+/**
+ * Half a unit in the last place the result could have been printed with
+ * @param text Formatted result
+ */
+static double PrintBound(const char *text)
+{
+  const char *exponent = strchr(text, 'E');
+  int negative = text[0] == '-';
+  int intLen, decimals;
+
+  if (exponent != NULL)
+  {
+    // d.dddE<exponent>: the mantissa keeps LCD_DISPLAY_WIDTH - 5 decimals
+    decimals = LCD_DISPLAY_WIDTH - negative - 5;
+    return 0.5 * pow(10.0, atoi(exponent + 1) - decimals);
+  }
+
+  intLen = (int)(strchr(text, '.') - text) - negative;
+  decimals = LCD_DISPLAY_WIDTH - negative - intLen - 1;
+  if (decimals >= RESULT_DECIMALS)
+  {
+#if NUMBER_BACKEND == NUMBER_BACKEND_FIXED
+    return 0; // Printed exactly
+#else
+    decimals = RESULT_DECIMALS;
+#endif
+  }
+  return 0.5 * pow(10.0, -decimals);
+}
+
+static void ReportDivergence(const Case *item, const RefResult *expected, const char *what)
+{
+  divergences++;
+  if (divergences > MAX_EXAMPLES)
+  {
+    return;
+  }
+  printf("DIVERGENCE (%s): \"%s\"\n", what, item->expr);
+  printf("  calculator: code %u, \"%s\"\n", item->error, item->text);
+  if (expected->error == CALC_OK)
+  {
+    printf("  reference:  code 0, %.10g\n", RefToDouble(&expected->result));
+  }
+  else
+  {
+    printf("  reference:  code %u\n", expected->error);
+  }
+}
+
+static void CheckCase(const Case *item)
+{
+  RefResult expected;
+  double value, exact, error, tolerance, print, units;
+  char *end;
+
+  RefEvaluate(item->expr, &expected);
+  capacityHits += expected.capacity;
+  expectedErrors[expected.error]++;
+
+  if (expected.literal)
+  {
+    ReportDivergence(item, &expected, "literal");
+    return;
+  }
+
+  if (item->error != expected.error)
+  {
+    ReportDivergence(item, &expected, "error code");
+    return;
+  }
+  if (expected.error != CALC_OK)
+  {
+    return;
+  }
+
+  value = strtod(item->text, &end);
+  if (end == item->text || *end != '\0' || strchr(item->text, '.') == NULL)
+  {
+    ReportDivergence(item, &expected, "result text");
+    return;
+  }
+
+  // The reference is exact, so one unit in the last place is the limit
+  exact = RefToDouble(&expected.result);
+  error = fabs(value - exact);
+  print = PrintBound(item->text);
+  tolerance = ResultUnit(exact) + print + REF_SLACK * (1 + fabs(exact));
+  if (error > tolerance)
+  {
+    ReportDivergence(item, &expected, "result value");
+    return;
+  }
+
+  error = error > print ? error - print : 0;
+  units = error / ResultUnit(exact);
+  mixStats[expected.mix].compared++;
+  mixStats[expected.mix].errorSum += units;
+  if (units > mixStats[expected.mix].errorMax)
+  {
+    mixStats[expected.mix].errorMax = units;
+  }
+}
+
+static double Now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long count = DEFAULT_COUNT;
+  unsigned long done = 0;
+  unsigned int batch, i, pos;
+  unsigned char mix, op;
+  char label[5];
+  double start, elapsed = 0;
+
+  if (argc > 1)
+  {
+    count = strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2)
+  {
+    rngState = strtoul(argv[2], NULL, 10);
+  }
+  if (count == 0 || rngState == 0)
+  {
+    fprintf(stderr, "fuzz: count and seed must be positive\n");
+    return 1;
+  }
+
+  Calculator_Init();
+
+  while (done < count)
+  {
+    batch = count - done < BATCH_SIZE ? (unsigned int)(count - done) : BATCH_SIZE;
+
+    for (i = 0; i < batch; i++)
+    {
+      Generate();
+      strcpy(cases[i].expr, genBuffer);
+      for (pos = 0; pos < genLen; pos++)
+      {
+        cases[i].typos[pos] = RandomBelow(20) == 0 ? alphabet[RandomBelow(ALPHABET_SIZE)] : 0;
+      }
+      cases[i].rewind = RandomBelow(4) == 0 ? RandomBelow(genLen) : 0xFF;
+    }
+
+    // Only the calculator is timed
+    start = Now();
+    for (i = 0; i < batch; i++)
+    {
+      RunCase(&cases[i]);
+    }
+    elapsed += Now() - start;
+
+    for (i = 0; i < batch; i++)
+    {
+      CheckCase(&cases[i]);
+    }
+    done += batch;
+  }
+
+  printf("cases:       %lu (%.0f evaluations/s)\n", count, count / (elapsed / 1e9));
+  printf("expected:    %lu ok, %lu syntax, %lu div by zero, %lu overflow\n",
+         expectedErrors[CALC_OK], expectedErrors[CALC_ERR_SYNTAX],
+         expectedErrors[CALC_ERR_DIV_ZERO], expectedErrors[CALC_ERR_OVERFLOW]);
+#if NUMBER_BACKEND == NUMBER_BACKEND_FLOAT
+  printf("literals:    max parse error %.3f ulp\n", literalErrorMax);
+#endif
+  printf("stack full:  %lu\n", capacityHits);
+
+  printf("\nerror beyond the printed rounding (%s, limit 1)\n", ERROR_UNIT);
+  printf("operators   compared         mean          max\n");
+  for (mix = 0; mix < MIX_COUNT; mix++)
+  {
+    if (mixStats[mix].compared == 0)
+    {
+      continue;
+    }
+    pos = 0;
+    for (op = 0; op < 4; op++)
+    {
+      if (mix & (1 << op))
+      {
+        label[pos++] = opSymbols[op];
+      }
+    }
+    label[pos] = '\0';
+    printf("%-9s %10lu %12.3f %12.3f\n", pos ? label : "none", mixStats[mix].compared,
+           mixStats[mix].errorSum / mixStats[mix].compared, mixStats[mix].errorMax);
+  }
+
+  printf("\ndivergences: %lu\n", divergences);
+  return divergences ? 1 : 0;
+}
@@ -1,203 +1,308 @@
 #include "keyboard.h"
-#include "delay.h"
-
-// Matrix keypad layout mapping
+#include "timer.h"
+#include "uart.h"
+
+// Keys are sampled by the Timer0 system tick, every KEY_SAMPLE_TICKS ticks.
+// Between samples all matrix rows are driven low, so a single read of the
+// column nibble tells whether any matrix key is down. Only then are the
+// four rows read one by one into a bitmap of all keys. Each key is
+// debounced independently (N-key rollover); a matrix without diodes still
+// shows ghost keys when three keys of a rectangle are held.
+
+// Number of keys: 16 matrix keys followed by the 8 independent keys
+#define MATRIX_KEY_COUNT 16
+#define KEY_COUNT 24
+
+// Sampling period in system ticks
+#define KEY_SAMPLE_TICKS 4
+
+// Debounce: a key changes state after 3 consecutive samples that differ
+// from its debounced state (2-bit counter per key, see Keyboard_Tick)
+
+// Keys that auto-repeat while held: backspace, scroll left, scroll right
+// (bits of keyMap)
+#define REPEAT_KEYS 0x00380000UL
+
+// Independent keys that are sampled: the serial port takes P3.0 and P3.1
+// (the '.' and '(' keys) when it is enabled
+#if UART_ENABLE
+#define KEY_P3_MASK 0xFC
+#else
+#define KEY_P3_MASK 0xFF
+#endif
+
+// Convert milliseconds to samples
+#define MS_TO_SAMPLES(ms) ((ms) / (KEY_SAMPLE_TICKS * TICK_MS))
+
+// Wait for the column lines to settle after changing the driven row
+// (the port pull-ups are weak; 8 cycles, 4 us at 24 MHz in 12T mode)
+#define KEY_SETTLE() \
+  _nop_();           \
+  _nop_();           \
+  _nop_();           \
+  _nop_();           \
+  _nop_();           \
+  _nop_();           \
+  _nop_();           \
+  _nop_()
+
+// Key layout mapping
+// Matrix keypad:
 // Row 0: 1  2  3  +
 // Row 1: 4  5  6  -
 // Row 2: 7  8  9  *
 // Row 3: C  0  =  /
-static unsigned char code matrixKeyMap[4][4] = {
-    {KEY_1, KEY_2, KEY_3, KEY_ADD},
-    {KEY_4, KEY_5, KEY_6, KEY_SUB},
-    {KEY_7, KEY_8, KEY_9, KEY_MUL},
-    {KEY_CLEAR, KEY_0, KEY_EQUAL, KEY_DIV}};
+// Independent keys: P3.0-P3.7 (the reserved keys produce no event)
+static unsigned char code keyMap[KEY_COUNT] = {
+    KEY_1, KEY_2, KEY_3, KEY_ADD,
+    KEY_4, KEY_5, KEY_6, KEY_SUB,
+    KEY_7, KEY_8, KEY_9, KEY_MUL,
+    KEY_CLEAR, KEY_0, KEY_EQUAL, KEY_DIV,
+    KEY_DOT_CHAR, KEY_LEFT_PAREN_CHAR, KEY_RIGHT_PAREN_CHAR, KEY_BACKSPACE_CHAR,
+    KEY_SCROLL_LEFT_CHAR, KEY_SCROLL_RIGHT_CHAR, KEY_NONE, KEY_NONE};
+
+// Key bitmaps (bit n = keyMap[n], 1 = down)
+static unsigned long keysDown = 0; // Debounced state
+
+// Debounce counters, one bit per key in each
+static unsigned long debounceCount0 = 0;
+static unsigned long debounceCount1 = 0;
+
+// Ticks until the next sample
+static unsigned char sampleDelay = 0;
+
+// Set by Keyboard_Resync until the next sample
+static bit resyncPending = 0;
+
+// Auto-repeat state
+static unsigned long repeatBit = 0;     // Bit of the held repeating key (0 = none)
+static unsigned char repeatKey;         // Its key code
+static unsigned char repeatCountdown;   // Samples until the next repeat
+static unsigned char repeatInterval;    // Current repeat interval in samples
+
+// Key event queue (ring buffer), filled by the tick and drained by the
+// main loop. The positions count events modulo 256; only the tick writes
+// keyQueueTail and only the main loop writes keyQueueHead.
+#define KEY_QUEUE_SIZE 8 // Must be a power of two
+static KeyEvent xdata keyQueue[KEY_QUEUE_SIZE];
+static unsigned char keyQueueHead = 0;          // Next event to read
+static volatile unsigned char keyQueueTail = 0; // Next free slot
+static unsigned int keyOverflowCount = 0;
+
+// Tick being processed by Keyboard_Tick
+static unsigned int tickNow;
 
 /**
  * @brief Initialize keyboard module
  */
 void Keyboard_Init(void)
 {
-  // Set P1 as input (for matrix keypad)
-  MATRIX_KEYPAD = 0xFF;
+  keysDown = 0;
+  debounceCount0 = 0;
+  debounceCount1 = 0;
+  sampleDelay = 0;
+  repeatBit = 0;
+  keyQueueHead = 0;
+  keyQueueTail = 0;
+  keyOverflowCount = 0;
+
+  // Drive all rows low, columns (P1.4-P1.7) as inputs
+  MATRIX_KEYPAD = 0xF0;
 
   // Set P3 as input (for independent keys)
   P3 = 0xFF;
 }
 
 /**
- * @brief Scan matrix keypad (4x4)
- * @return Key code if pressed, KEY_NONE if no key pressed
+ * @brief Add a key press to the event queue
+ * @param key Key code
  */
-unsigned char Keyboard_ScanMatrix(void)
+static void QueueKey(unsigned char key)
 {
-  unsigned char row, col;
-  unsigned char keyValue = KEY_NONE;
+  KeyEvent xdata *event;
 
-  // Scan each row
-  for (row = 0; row < 4; row++)
+  if ((unsigned char)(keyQueueTail - keyQueueHead) >= KEY_QUEUE_SIZE)
   {
-    // Set all rows high, then set current row low
-    MATRIX_KEYPAD = 0xFF;
-    MATRIX_KEYPAD &= ~(0x01 << row); // Pull current row low
-
-    // Small delay for signal stabilization
-    delayMicroseconds(10);
-
-    // Check each column
-    for (col = 0; col < 4; col++)
-    {
-      // Check if column is low (key pressed)
-      if ((MATRIX_KEYPAD & (0x10 << col)) != 0)
-      {
-        continue;
-      }
-
-      // Debounce delay
-      delayMiliseconds(10);
-
-      // Confirm key is still pressed
-      if ((MATRIX_KEYPAD & (0x10 << col)) != 0)
-      {
-        continue;
-      }
-
-      // Key is confirmed pressed, get key value
-      keyValue = matrixKeyMap[row][col];
+    keyOverflowCount++;
+    return;
+  }
 
-      // Wait for key release
-      while ((MATRIX_KEYPAD & (0x10 << col)) == 0)
-        ;
+  event = &keyQueue[keyQueueTail % KEY_QUEUE_SIZE];
+  event->key = key;
+  event->time = tickNow;
+  keyQueueTail++;
+}
 
-      // Debounce delay after release
-      delayMiliseconds(10);
+/**
+ * @brief Read the matrix keypad
+ * All rows are driven low on entry and on return
+ * @return Bitmap of the keys that are down (bit row * 4 + column)
+ */
+static unsigned int ReadMatrix(void)
+{
+  unsigned int keys;
+  unsigned char row;
 
-      return keyValue;
-    }
+  // Fast check: no column pulled low means no key is down
+  if ((MATRIX_KEYPAD & 0xF0) == 0xF0)
+  {
+    return 0;
   }
 
-  // Restore P1 to all high
-  MATRIX_KEYPAD = 0xFF;
+  keys = 0;
+  for (row = 0; row < 4; row++)
+  {
+    MATRIX_KEYPAD = ~(0x01 << row);
+    KEY_SETTLE();
+    keys |= (unsigned int)((~MATRIX_KEYPAD >> 4) & 0x0F) << (row * 4);
+  }
 
-  return KEY_NONE;
+  MATRIX_KEYPAD = 0xF0;
+  return keys;
 }
 
 /**
- * @brief Scan independent keys
- * @return Key code if pressed, KEY_NONE if no key pressed
+ * @brief Sample the keys and run the debounce state machines
+ * @param now Current system tick
  */
-unsigned char Keyboard_ScanIndependent(void)
+void Keyboard_Tick(unsigned int now)
 {
-  // Check dot key
-  if (KEY_DOT == 0)
-  {
-    delayMiliseconds(10); // Debounce
-    if (KEY_DOT != 0)
-    {
-      return KEY_NONE;
-    }
+  unsigned long keys, changed, toggled;
+  unsigned char index;
 
-    while (KEY_DOT == 0)
-      ; // Wait for release
-    delayMiliseconds(10);
-    return KEY_DOT_CHAR;
+  if (sampleDelay > 0)
+  {
+    sampleDelay--;
+    return;
   }
+  sampleDelay = KEY_SAMPLE_TICKS - 1;
 
-  // Check left parenthesis key
-  if (KEY_LEFT_PAREN == 0)
-  {
-    delayMiliseconds(10);
-    if (KEY_LEFT_PAREN != 0)
-    {
-      return KEY_NONE;
-    }
+  // Independent keys read low when pressed
+  keys = ReadMatrix() | ((unsigned long)(unsigned char)(~P3 & KEY_P3_MASK) << MATRIX_KEY_COUNT);
 
-    while (KEY_LEFT_PAREN == 0)
-      ;
-    delayMiliseconds(10);
-    return KEY_LEFT_PAREN_CHAR;
+  // Take the keys down now as debounced without reporting them
+  if (resyncPending)
+  {
+    resyncPending = 0;
+    keysDown = keys;
+    debounceCount0 = 0;
+    debounceCount1 = 0;
+    repeatBit = 0;
+    return;
   }
 
-  // Check right parenthesis key
-  if (KEY_RIGHT_PAREN == 0)
+  // Idle: nothing down now or before
+  if (keys == 0 && keysDown == 0)
   {
-    delayMiliseconds(10);
-    if (KEY_RIGHT_PAREN != 0)
-    {
-      return KEY_NONE;
-    }
-
-    while (KEY_RIGHT_PAREN == 0)
-      ;
-    delayMiliseconds(10);
-    return KEY_RIGHT_PAREN_CHAR;
+    debounceCount0 = 0;
+    debounceCount1 = 0;
+    return;
   }
 
-  // Check backspace key
-  if (KEY_BACKSPACE == 0)
+  // Count consecutive samples that differ from the debounced state
+  // (counters of keys that agree are reset), and toggle the keys whose
+  // counter reaches 3
+  changed = keys ^ keysDown;
+  debounceCount1 = (debounceCount1 ^ debounceCount0) & changed;
+  debounceCount0 = ~debounceCount0 & changed;
+  toggled = debounceCount0 & debounceCount1;
+  debounceCount0 &= ~toggled;
+  debounceCount1 &= ~toggled;
+  keysDown ^= toggled;
+
+  // Queue the new presses (releases only update keysDown)
+  tickNow = now;
+  toggled &= keysDown;
+  for (index = 0; toggled != 0; index++, toggled >>= 1)
   {
-    delayMiliseconds(10);
-    if (KEY_BACKSPACE != 0)
+    if ((toggled & 1) && keyMap[index] != KEY_NONE)
     {
-      return KEY_NONE;
-    }
+      QueueKey(keyMap[index]);
 
-    while (KEY_BACKSPACE == 0)
-      ;
-    delayMiliseconds(10);
-    return KEY_BACKSPACE_CHAR;
+      // The last repeating key pressed takes over auto-repeat
+      if ((REPEAT_KEYS >> index) & 1)
+      {
+        repeatBit = 1UL << index;
+        repeatKey = keyMap[index];
+        repeatCountdown = MS_TO_SAMPLES(KEY_REPEAT_DELAY_MS);
+        repeatInterval = MS_TO_SAMPLES(KEY_REPEAT_START_MS);
+      }
+    }
   }
 
-  // Check scroll left key (K5)
-  if (KEY_SCROLL_LEFT == 0)
+  // Auto-repeat while the key stays down, faster on every repeat
+  if (!(keysDown & repeatBit))
   {
-    delayMiliseconds(10);
-    if (KEY_SCROLL_LEFT != 0)
-    {
-      return KEY_NONE;
-    }
-
-    while (KEY_SCROLL_LEFT == 0)
-      ;
-    delayMiliseconds(10);
-    return KEY_SCROLL_LEFT_CHAR;
+    repeatBit = 0;
+    return;
   }
-
-  // Check scroll right key (K6)
-  if (KEY_SCROLL_RIGHT == 0)
+  if (--repeatCountdown == 0)
   {
-    delayMiliseconds(10);
-    if (KEY_SCROLL_RIGHT != 0)
+    QueueKey(repeatKey);
+    repeatCountdown = repeatInterval;
+    if (repeatInterval > MS_TO_SAMPLES(KEY_REPEAT_MIN_MS) + MS_TO_SAMPLES(KEY_REPEAT_STEP_MS))
+    {
+      repeatInterval -= MS_TO_SAMPLES(KEY_REPEAT_STEP_MS);
+    }
+    else
     {
-      return KEY_NONE;
+      repeatInterval = MS_TO_SAMPLES(KEY_REPEAT_MIN_MS);
     }
+  }
+}
+
+/**
+ * @brief Take the keys that are down now as already reported
+ */
+void Keyboard_Resync(void)
+{
+  resyncPending = 1;
+}
 
-    while (KEY_SCROLL_RIGHT == 0)
-      ;
-    delayMiliseconds(10);
-    return KEY_SCROLL_RIGHT_CHAR;
+/**
+ * @brief Take the next key press event from the queue (does not wait)
+ * @param event Pointer to store the event
+ * @return 1=event returned, 0=queue is empty
+ */
+unsigned char Keyboard_GetEvent(KeyEvent *event)
+{
+  if (keyQueueHead == keyQueueTail)
+  {
+    return 0;
   }
 
-  return KEY_NONE;
+  // The tick does not touch this slot until keyQueueHead moves past it
+  *event = keyQueue[keyQueueHead % KEY_QUEUE_SIZE];
+  keyQueueHead++;
+  return 1;
 }
 
 /**
- * @brief Scan all keyboards (matrix + independent)
- * @return Key code if pressed, KEY_NONE if no key pressed
+ * @brief Get the next key press from the queue (does not wait)
+ * @return Key code if a key was pressed, KEY_NONE otherwise
  */
 unsigned char Keyboard_Scan(void)
 {
-  unsigned char key;
+  KeyEvent event;
 
-  // First scan matrix keypad
-  key = Keyboard_ScanMatrix();
-
-  // If matrix key pressed, early return
-  if (key != KEY_NONE)
+  if (!Keyboard_GetEvent(&event))
   {
-    return key;
+    return KEY_NONE;
   }
+  return event.key;
+}
+
+/**
+ * @brief Get the number of key presses dropped because the queue was full
+ * @return Overflow count
+ */
+unsigned int Keyboard_GetOverflowCount(void)
+{
+  unsigned int count;
+
+  ET0 = 0; // Read both bytes from the same tick
+  count = keyOverflowCount;
+  ET0 = 1;
 
-  // Then scan independent keys
-  key = Keyboard_ScanIndependent();
-  return key;
+  return count;
 }
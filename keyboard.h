@@ -1,20 +1,20 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
-#include <reg52.h>
+#include "hal.h"
 
 // Matrix Keypad Pin Definitions (Connected to P1)
 #define MATRIX_KEYPAD P1
 
 // Independent Keys Pin Definitions (Connected to P3)
-sbit KEY_DOT = P3 ^ 0;          // '.'
-sbit KEY_LEFT_PAREN = P3 ^ 1;   // '('
-sbit KEY_RIGHT_PAREN = P3 ^ 2;  // ')'
-sbit KEY_BACKSPACE = P3 ^ 3;    // Backspace
-sbit KEY_SCROLL_LEFT = P3 ^ 4;  // Scroll left (K5)
-sbit KEY_SCROLL_RIGHT = P3 ^ 5; // Scroll right (K6)
-sbit KEY_RESERVED_3 = P3 ^ 6;   // Reserved
-sbit KEY_RESERVED_4 = P3 ^ 7;   // Reserved
+HAL_SBIT(KEY_DOT, HAL_P3, 0);          // '.'
+HAL_SBIT(KEY_LEFT_PAREN, HAL_P3, 1);   // '('
+HAL_SBIT(KEY_RIGHT_PAREN, HAL_P3, 2);  // ')'
+HAL_SBIT(KEY_BACKSPACE, HAL_P3, 3);    // Backspace
+HAL_SBIT(KEY_SCROLL_LEFT, HAL_P3, 4);  // Scroll left (K5)
+HAL_SBIT(KEY_SCROLL_RIGHT, HAL_P3, 5); // Scroll right (K6)
+HAL_SBIT(KEY_RESERVED_3, HAL_P3, 6);   // Reserved
+HAL_SBIT(KEY_RESERVED_4, HAL_P3, 7);   // Reserved
 
 // Key Code Definitions
 // Matrix Keypad (16 keys)
@@ -46,27 +46,65 @@ sbit KEY_RESERVED_4 = P3 ^ 7;   // Reserved
 // No Key Pressed
 #define KEY_NONE 0x00
 
+// Auto-repeat for backspace and the scroll keys: after being held for
+// KEY_REPEAT_DELAY_MS the key repeats, first every KEY_REPEAT_START_MS,
+// then KEY_REPEAT_STEP_MS faster on each repeat down to KEY_REPEAT_MIN_MS
+// (each at most 1000 ms)
+#ifndef KEY_REPEAT_DELAY_MS
+#define KEY_REPEAT_DELAY_MS 500
+#endif
+#ifndef KEY_REPEAT_START_MS
+#define KEY_REPEAT_START_MS 160
+#endif
+#ifndef KEY_REPEAT_MIN_MS
+#define KEY_REPEAT_MIN_MS 40
+#endif
+#ifndef KEY_REPEAT_STEP_MS
+#define KEY_REPEAT_STEP_MS 20
+#endif
+
+// Key press event
+typedef struct
+{
+  unsigned char key; // Key code
+  unsigned int time; // System tick of the press (see Timer_GetTicks)
+} KeyEvent;
+
 /**
  * @brief Initialize keyboard module
  */
 void Keyboard_Init(void);
 
 /**
- * @brief Scan matrix keypad (4x4)
- * @return Key code if pressed, KEY_NONE if no key pressed
+ * @brief Sample the keys and run the debounce state machines
+ * Called from the Timer0 system tick, see timer.c
+ * @param now Current system tick
+ */
+void Keyboard_Tick(unsigned int now);
+
+/**
+ * @brief Take the keys that are down now as already reported
+ * Used after wake-up, so the key that woke the chip is not reported
  */
-unsigned char Keyboard_ScanMatrix(void);
+void Keyboard_Resync(void);
 
 /**
- * @brief Scan independent keys
- * @return Key code if pressed, KEY_NONE if no key pressed
+ * @brief Take the next key press event from the queue (does not wait)
+ * @param event Pointer to store the event
+ * @return 1=event returned, 0=queue is empty
  */
-unsigned char Keyboard_ScanIndependent(void);
+unsigned char Keyboard_GetEvent(KeyEvent *event);
 
 /**
- * @brief Scan all keyboards (matrix + independent)
- * @return Key code if pressed, KEY_NONE if no key pressed
+ * @brief Get the next key press from the queue (does not wait)
+ * @return Key code if a key was pressed, KEY_NONE otherwise
  */
 unsigned char Keyboard_Scan(void);
 
+/**
+ * @brief Get the number of key presses dropped because the queue was full
+ * @return Overflow count
+ */
+unsigned int Keyboard_GetOverflowCount(void);
+
 #endif // KEYBOARD_H
\ No newline at end of file
@@ -1,17 +1,274 @@
 #include "lcd.h"
 #include "delay.h"
 #include "font_table.h"
+#include "profile.h"
 
+// Give up waiting for the busy flag after this many status reads (a
+// missing display must not hang the firmware)
+#define LCD_BUSY_TIMEOUT 1000
+
+// Status reads that found the controller busy
+static unsigned long lcdBusyCount = 0;
+
+// Command and data bytes sent
+static unsigned long lcdBytesSent = 0;
+
+// Shadow framebuffer: character codes to display, and the codes the LCD
+// has received. lcdShadow holds the whole line of LCD_SCROLL_ROW and the
+// first LCD_COLUMNS (screen columns) of the other rows; lcdSent mirrors
+// the DDRAM of each line.
+static unsigned char xdata lcdShadow[LCD_ROWS][LCD_LINE_LENGTH];
+static unsigned char xdata lcdSent[LCD_ROWS][LCD_LINE_LENGTH];
+static bit lcdDirty = 0; // lcdShadow differs from lcdSent
+
+// Display shift: line column shown in screen column 0, as requested by
+// LCD_SetShift and as queued for the LCD
+static unsigned char lcdShiftTarget = 0;
+static unsigned char lcdShift = 0;
+
+// Shadow framebuffer cursor
+static unsigned char lcdRow = 0;
+static unsigned char lcdCol = 0;
+
+// LCD address counter after the queued writes, if known
+#define LCD_ADDRESS_UNKNOWN 0xFF
+static unsigned char lcdAddress = LCD_ADDRESS_UNKNOWN;
+
+// Write queue (ring buffer), filled by LCD_Flush and drained by LCD_Tick.
+// The positions count writes modulo 256; only LCD_Tick writes
+// lcdQueueHead and only the main loop writes lcdQueueTail.
+typedef struct
+{
+  unsigned char isData; // 1=data byte, 0=command byte
+  unsigned char value;
+} LcdWrite;
+
+static LcdWrite xdata lcdQueue[LCD_QUEUE_SIZE];
+static volatile unsigned char lcdQueueHead = 0; // Next write to send
+static unsigned char lcdQueueTail = 0;          // Next free slot
+
+#if LCD_USE_BUSY_FLAG
+// Ticks the head of the queue has waited for the busy flag
+static unsigned char lcdTickWait = 0;
+
+// Send the write anyway after this many busy ticks (a missing display
+// must not stall the queue)
+#define LCD_TICK_TIMEOUT 10
+
+// Writes sent per tick at most, and status reads spent waiting for each
+// (a write takes about 40us, a status read a few microseconds), so a
+// two-row redraw takes a few ticks instead of one tick per byte
+#define LCD_TICK_WRITES 8
+#define LCD_TICK_POLLS 16
+#endif
+
+// Bus cycles, shared by the main loop and LCD_Tick (plain macros, so
+// the interrupt never calls into functions the main loop uses)
+
+// Enable pulse: high for at least 450ns (two cycles even in 6T mode)
+#define LCD_PULSE_ENABLE() \
+  LCD_EN = 1;              \
+  _nop_();                 \
+  _nop_();                 \
+  LCD_EN = 0
+
+// Write a byte to the instruction (rs = 0) or data (rs = 1) register
+#define LCD_BUS_WRITE(rs, value) \
+  LCD_RS = (rs);                 \
+  LCD_RW = 0;                    \
+  LCD_DATA = (value);            \
+  LCD_PULSE_ENABLE()
+
+// Read the busy flag and address counter into status (the data bus is
+// released first; data is valid at most 360ns after enable)
+#define LCD_BUS_READ_STATUS(status) \
+  LCD_DATA = 0xFF;                  \
+  LCD_RS = 0;                       \
+  LCD_RW = 1;                       \
+  LCD_EN = 1;                       \
+  _nop_();                          \
+  _nop_();                          \
+  (status) = LCD_DATA;              \
+  LCD_EN = 0;                       \
+  LCD_RW = 0
+
+/**
+ * @brief Read the busy flag and address counter
+ * @return LCD_BUSY_FLAG if busy, ORed with the address counter
+ */
+unsigned char LCD_ReadStatus(void)
+{
+  unsigned char status;
+
+  LCD_BUS_READ_STATUS(status);
+
+  return status;
+}
+
+/**
+ * @brief Get the number of status reads that found the controller busy
+ * @return Busy poll count
+ */
+unsigned long LCD_GetBusyCount(void)
+{
+  unsigned long count;
+
+  ET0 = 0; // LCD_Tick counts in the system tick
+  count = lcdBusyCount;
+  ET0 = 1;
+
+  return count;
+}
+
+/**
+ * @brief Get the number of command and data bytes sent or queued
+ * @return Byte count
+ */
+unsigned long LCD_GetBytesSent(void)
+{
+  return lcdBytesSent;
+}
+
+/**
+ * @brief Get the number of writes waiting in the queue for LCD_Tick
+ * @return Queued write count
+ */
+unsigned char LCD_GetQueued(void)
+{
+  return lcdQueueTail - lcdQueueHead;
+}
+
+/**
+ * @brief Count a write and track the address counter it leaves
+ * @param isData 1=data byte, 0=command byte
+ * @param value Byte written
+ */
+static void LCD_TrackWrite(unsigned char isData, unsigned char value)
+{
+  lcdBytesSent++;
+
+  if (isData)
+  {
+    // The address counter increments after each data write
+    if (lcdAddress != LCD_ADDRESS_UNKNOWN)
+    {
+      lcdAddress++;
+    }
+  }
+  else if (value & LCD_SET_DDRAM_ADDR)
+  {
+    lcdAddress = value & LCD_ADDRESS_MASK;
+  }
+  else if (value == LCD_SHIFT_LEFT || value == LCD_SHIFT_RIGHT)
+  {
+    // Display shifts leave the address counter alone
+  }
+  else
+  {
+    lcdAddress = LCD_ADDRESS_UNKNOWN;
+  }
+}
+
+/**
+ * @brief Add a write to the queue (the caller checks for space)
+ * @param isData 1=data byte, 0=command byte
+ * @param value Byte to write
+ */
+static void LCD_Enqueue(unsigned char isData, unsigned char value)
+{
+  LcdWrite xdata *entry;
+
+  entry = &lcdQueue[lcdQueueTail % LCD_QUEUE_SIZE];
+  entry->isData = isData;
+  entry->value = value;
+  lcdQueueTail++;
+
+  LCD_TrackWrite(isData, value);
+}
+
+/**
+ * @brief Send the queued writes the controller is ready for
+ * Called from the system tick
+ */
+void LCD_Tick(void)
+{
+  LcdWrite xdata *entry;
+#if LCD_USE_BUSY_FLAG
+  unsigned char status;
+  unsigned char writes;
+  unsigned char polls;
+
+  for (writes = 0; writes < LCD_TICK_WRITES && lcdQueueHead != lcdQueueTail; writes++)
+  {
+    // Wait briefly for the previous write, then try again next tick
+    // rather than waiting in the interrupt
+    for (polls = 0; polls < LCD_TICK_POLLS; polls++)
+    {
+      LCD_BUS_READ_STATUS(status);
+      if (!(status & LCD_BUSY_FLAG))
+      {
+        break;
+      }
+      lcdBusyCount++;
+    }
+    if (polls == LCD_TICK_POLLS)
+    {
+      if (writes > 0 || ++lcdTickWait < LCD_TICK_TIMEOUT)
+      {
+        return;
+      }
+    }
+    lcdTickWait = 0;
+
+    entry = &lcdQueue[lcdQueueHead % LCD_QUEUE_SIZE];
+    LCD_BUS_WRITE(entry->isData, entry->value);
+    lcdQueueHead++;
+  }
+#else
+  if (lcdQueueHead == lcdQueueTail)
+  {
+    return;
+  }
+
+  // A tick is far longer than any write except clear, which is never
+  // queued, so the previous write has completed in fixed delay mode
+  entry = &lcdQueue[lcdQueueHead % LCD_QUEUE_SIZE];
+  LCD_BUS_WRITE(entry->isData, entry->value);
+  lcdQueueHead++;
+#endif
+}
+
+/**
+ * @brief Wait until LCD_Tick has sent every queued write
+ */
+static void LCD_WaitQueue(void)
+{
+  while (lcdQueueHead != lcdQueueTail)
+  {
+  }
+#if !LCD_USE_BUSY_FLAG
+  delayMicroseconds(50); // The last queued write may still be executing
+#endif
+}
+
+#if LCD_USE_BUSY_FLAG
 /**
- * @brief LCD enable signal
+ * @brief Wait until the controller can take the next command or data
  */
-static void LCD_Enable(void)
+static void LCD_WaitReady(void)
 {
-  LCD_EN = 1;
-  delayMicroseconds(1); // Enable signal high level for at least 450ns
-  LCD_EN = 0;
-  delayMicroseconds(1); // Enable signal low level hold
+  unsigned int polls;
+
+  for (polls = 0; polls < LCD_BUSY_TIMEOUT; polls++)
+  {
+    if (!(LCD_ReadStatus() & LCD_BUSY_FLAG))
+    {
+      return;
+    }
+    lcdBusyCount++;
+  }
 }
+#endif
 
 /**
  * @brief Write command to LCD
@@ -19,11 +276,15 @@ static void LCD_Enable(void)
  */
 void LCD_WriteCmd(unsigned char cmd)
 {
-  LCD_RS = 0;            // Select instruction register
-  LCD_RW = 0;            // Write mode
-  LCD_DATA = cmd;        // Put command on data bus
-  LCD_Enable();          // Generate enable signal
+  LCD_WaitQueue(); // Keep the queued writes in order
+#if LCD_USE_BUSY_FLAG
+  LCD_WaitReady(); // Wait for the previous command
+#endif
+  LCD_BUS_WRITE(0, cmd);
+#if !LCD_USE_BUSY_FLAG
   delayMicroseconds(50); // Wait for command execution
+#endif
+  LCD_TrackWrite(0, cmd);
 }
 
 /**
@@ -32,61 +293,243 @@ void LCD_WriteCmd(unsigned char cmd)
  */
 void LCD_WriteData(unsigned char dat)
 {
-  LCD_RS = 1;            // Select data register
-  LCD_RW = 0;            // Write mode
-  LCD_DATA = dat;        // Put data on data bus
-  LCD_Enable();          // Generate enable signal
+  LCD_WaitQueue(); // Keep the queued writes in order
+#if LCD_USE_BUSY_FLAG
+  LCD_WaitReady(); // Wait for the previous command
+#endif
+  LCD_BUS_WRITE(1, dat);
+#if !LCD_USE_BUSY_FLAG
   delayMicroseconds(50); // Wait for data write completion
+#endif
+  LCD_TrackWrite(1, dat);
+}
+
+/**
+ * @brief Write a command of the reset sequence (the caller waits)
+ * @param cmd Command byte
+ */
+static void LCD_WriteInitCmd(unsigned char cmd)
+{
+  LCD_BUS_WRITE(0, cmd);
+  LCD_TrackWrite(0, cmd);
 }
 
 /**
  * @brief Initialize LCD1602
+ * Initializing by instruction (HD44780 datasheet): this also works when
+ * the controller's power-on reset did not run cleanly (slow power ramp).
+ * The busy flag cannot be checked until the sequence is complete, so it
+ * uses fixed delays.
  */
 void LCD_Init(void)
 {
   delayMiliseconds(15); // Wait for LCD power-on stabilization
 
-  LCD_WriteCmd(LCD_FUNCTION_SET); // Function set: 8-bit data, 2 lines, 5x7 dots
+  LCD_WriteInitCmd(LCD_FUNCTION_RESET);
+  delayMiliseconds(5); // More than 4.1 ms
+  LCD_WriteInitCmd(LCD_FUNCTION_RESET);
+  delayMicroseconds(100); // More than 100 us
+  LCD_WriteInitCmd(LCD_FUNCTION_RESET);
+  delayMicroseconds(100);
+  LCD_WriteInitCmd(LCD_FUNCTION_SET); // 8-bit data, 2 lines, 5x7 dots
   delayMicroseconds(50);
 
-  LCD_WriteCmd(LCD_DISPLAY_ON); // Display on, cursor off, no blink
-  delayMicroseconds(50);
+  // From here on the busy flag is valid (LCD_USE_BUSY_FLAG)
+  LCD_WriteCmd(LCD_DISPLAY_ON);   // Display on, cursor off, no blink
+  LCD_Clear();                    // Clear screen
+  LCD_WriteCmd(LCD_ENTRY_MODE);   // Cursor moves right, display does not shift
+}
+
+/**
+ * @brief Queue a cell of the shadow framebuffer if the LCD differs
+ * @param row Row number
+ * @param col Line column (0-39)
+ * @param charCode Character code the cell must show
+ * @return 1=cell is up to date or queued, 0=queue is full
+ */
+static unsigned char LCD_FlushCell(unsigned char row, unsigned char col, unsigned char charCode)
+{
+  unsigned char address;
 
-  LCD_WriteCmd(LCD_CLEAR); // Clear screen
-  delayMiliseconds(2);     // Clear command needs longer time
+  if (lcdSent[row][col] == charCode)
+  {
+    return 1;
+  }
 
-  LCD_WriteCmd(LCD_ENTRY_MODE); // Cursor moves right, display does not shift
-  delayMicroseconds(50);
+  // Leave the rest for the next flush if the cell might not fit
+  if ((unsigned char)(lcdQueueTail - lcdQueueHead) > LCD_QUEUE_SIZE - 2)
+  {
+    return 0;
+  }
+
+  // Set the address unless the previous write left it here
+  address = (row == 0 ? 0x00 : 0x40) + col; // Line addresses: 0x00-0x27, 0x40-0x67
+  if (address != lcdAddress)
+  {
+    LCD_Enqueue(0, LCD_SET_DDRAM_ADDR | address);
+  }
+  LCD_Enqueue(1, charCode);
+  lcdSent[row][col] = charCode;
+  return 1;
+}
+
+/**
+ * @brief Queue the display shift and the changed cells of the shadow
+ * framebuffer, as far as the queue has room
+ */
+static void LCD_FlushShadow(void)
+{
+  unsigned char row, col;
+
+  lcdDirty = 0;
+
+  // Shift towards the target the short way round, one column per command
+  while (lcdShift != lcdShiftTarget)
+  {
+    if ((unsigned char)(lcdQueueTail - lcdQueueHead) >= LCD_QUEUE_SIZE)
+    {
+      lcdDirty = 1;
+      return;
+    }
+
+    if ((unsigned char)(lcdShiftTarget + LCD_LINE_LENGTH - lcdShift) % LCD_LINE_LENGTH <= LCD_LINE_LENGTH / 2)
+    {
+      LCD_Enqueue(0, LCD_SHIFT_LEFT);
+      lcdShift = (lcdShift + 1) % LCD_LINE_LENGTH;
+    }
+    else
+    {
+      LCD_Enqueue(0, LCD_SHIFT_RIGHT);
+      lcdShift = (lcdShift + LCD_LINE_LENGTH - 1) % LCD_LINE_LENGTH;
+    }
+  }
+
+  for (row = 0; row < LCD_ROWS; row++)
+  {
+    if (row == LCD_SCROLL_ROW)
+    {
+      // The whole line moves with the shift
+      for (col = 0; col < LCD_LINE_LENGTH; col++)
+      {
+        if (!LCD_FlushCell(row, col, lcdShadow[row][col]))
+        {
+          lcdDirty = 1;
+          return;
+        }
+      }
+    }
+    else
+    {
+      // Fixed rows: rewrite whichever line columns are on screen now
+      for (col = 0; col < LCD_COLUMNS; col++)
+      {
+        if (!LCD_FlushCell(row, (lcdShift + col) % LCD_LINE_LENGTH, lcdShadow[row][col]))
+        {
+          lcdDirty = 1;
+          return;
+        }
+      }
+    }
+  }
 }
 
 /**
- * @brief Set cursor position
+ * @brief Queue the display shift and the changed cells of the shadow
+ * framebuffer for the LCD
+ */
+void LCD_Flush(void)
+{
+  if (!lcdDirty)
+  {
+    return;
+  }
+
+  PROFILE_BEGIN(PROFILE_LCD_DRAW);
+  LCD_FlushShadow();
+  PROFILE_END(PROFILE_LCD_DRAW);
+}
+
+/**
+ * @brief Flush the shadow framebuffer and wait until the LCD shows it
+ */
+void LCD_Sync(void)
+{
+  do
+  {
+    LCD_Flush();
+    LCD_WaitQueue();
+  } while (lcdDirty);
+}
+
+/**
+ * @brief Set cursor position (for the Show functions)
  * @param row Row number (0 or 1)
- * @param col Column number (0-15)
+ * @param col Column number (0-15, or line column 0-39 on LCD_SCROLL_ROW)
  */
 void LCD_SetCursor(unsigned char row, unsigned char col)
 {
-  unsigned char addr;
+  lcdRow = row;
+  lcdCol = col;
+}
 
-  if (row == 0)
+/**
+ * @brief Scroll the display (both rows shift on the LCD; the fixed rows
+ * are redrawn at the new position)
+ * @param shift Line column of LCD_SCROLL_ROW to show in screen column 0
+ */
+void LCD_SetShift(unsigned char shift)
+{
+  if (shift != lcdShiftTarget)
   {
-    addr = 0x00 + col; // First line address range: 0x00-0x0F
+    lcdShiftTarget = shift;
+    lcdDirty = 1;
   }
-  else
+}
+
+/**
+ * @brief Clear a row of the shadow framebuffer
+ * @param row Row number (0 or 1); clears the whole line of LCD_SCROLL_ROW
+ */
+void LCD_ClearRow(unsigned char row)
+{
+  unsigned char col;
+
+  for (col = 0; col < LCD_LINE_LENGTH; col++)
   {
-    addr = 0x40 + col; // Second line address range: 0x40-0x4F
+    if (lcdShadow[row][col] != ' ')
+    {
+      lcdShadow[row][col] = ' ';
+      lcdDirty = 1;
+    }
   }
-
-  LCD_WriteCmd(LCD_SET_DDRAM_ADDR | addr); // Set DDRAM address
 }
 
 /**
- * @brief Clear screen
+ * @brief Clear screen (immediately, including the shadow framebuffer)
  */
 void LCD_Clear(void)
 {
+  unsigned char row, col;
+
   LCD_WriteCmd(LCD_CLEAR);
+#if !LCD_USE_BUSY_FLAG
   delayMiliseconds(2); // Clear command needs longer time
+#endif
+  lcdAddress = 0x00; // Clear also returns the address counter to 0
+  lcdShift = 0;      // and undoes the display shift
+  lcdShiftTarget = 0;
+
+  for (row = 0; row < LCD_ROWS; row++)
+  {
+    for (col = 0; col < LCD_LINE_LENGTH; col++)
+    {
+      lcdShadow[row][col] = ' ';
+      lcdSent[row][col] = ' ';
+    }
+  }
+  lcdDirty = 0;
+  lcdRow = 0;
+  lcdCol = 0;
 }
 
 /**
@@ -96,9 +539,17 @@ void LCD_Clear(void)
 void LCD_ShowChar(unsigned char c)
 {
   unsigned char charCode = getLCD1602CharCode(c);
-  LCD_WriteData(charCode);
-}
 
+  if (lcdCol < (lcdRow == LCD_SCROLL_ROW ? LCD_LINE_LENGTH : LCD_COLUMNS))
+  {
+    if (lcdShadow[lcdRow][lcdCol] != charCode)
+    {
+      lcdShadow[lcdRow][lcdCol] = charCode;
+      lcdDirty = 1;
+    }
+    lcdCol++;
+  }
+}
 /**
  * @brief Display a string on LCD
  * @param str String to display
@@ -115,7 +566,7 @@ void LCD_ShowString(unsigned char *str)
 /**
  * @brief Display a character at specified position
  * @param row Row number (0 or 1)
- * @param col Column number (0-15)
+ * @param col Column number (0-15, or line column 0-39 on LCD_SCROLL_ROW)
  * @param c Character to display
  */
 void LCD_ShowCharAt(unsigned char row, unsigned char col, unsigned char c)
@@ -127,7 +578,7 @@ void LCD_ShowCharAt(unsigned char row, unsigned char col, unsigned char c)
 /**
  * @brief Display a string at specified position
  * @param row Row number (0 or 1)
- * @param col Column number (0-15)
+ * @param col Column number (0-15, or line column 0-39 on LCD_SCROLL_ROW)
  * @param str String to display
  */
 void LCD_ShowStringAt(unsigned char row, unsigned char col, unsigned char *str)
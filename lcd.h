@@ -1,13 +1,41 @@
 #ifndef LCD_H
 #define LCD_H
 
-#include <reg52.h>
+#include "hal.h"
 
 // LCD1602 Pin Definitions
-#define LCD_DATA P0   // 8-bit data bus DB0-DB7
-sbit LCD_RW = P2 ^ 5; // R/W: Read/Write Select (0=Write, 1=Read)
-sbit LCD_RS = P2 ^ 6; // RS: Register Select (0=Instruction, 1=Data)
-sbit LCD_EN = P2 ^ 7; // E: Enable Signal
+#define LCD_DATA P0 // 8-bit data bus DB0-DB7
+HAL_SBIT(LCD_RW, HAL_P2, 5); // R/W: Read/Write Select (0=Write, 1=Read)
+HAL_SBIT(LCD_RS, HAL_P2, 6); // RS: Register Select (0=Instruction, 1=Data)
+HAL_SBIT(LCD_EN, HAL_P2, 7); // E: Enable Signal
+
+// Wait for the controller by polling its busy flag (1), or by fixed
+// worst-case delays after every write (0)
+#ifndef LCD_USE_BUSY_FLAG
+#define LCD_USE_BUSY_FLAG 1
+#endif
+
+// Writes the LCD queue can hold (must be a power of two, at most 128;
+// larger redraws are split across flushes)
+#ifndef LCD_QUEUE_SIZE
+#define LCD_QUEUE_SIZE 64
+#endif
+
+// Display size
+#define LCD_ROWS 2
+#define LCD_COLUMNS 16
+
+// DDRAM characters per line; the display shift selects which
+// LCD_COLUMNS of them are on screen
+#define LCD_LINE_LENGTH 40
+
+// Row drawn in line columns that scrolls with the display shift; the
+// other rows are drawn in screen columns and stay in place
+#define LCD_SCROLL_ROW 0
+
+// Status register bits (see LCD_ReadStatus)
+#define LCD_BUSY_FLAG 0x80    // Controller busy
+#define LCD_ADDRESS_MASK 0x7F // Address counter
 
 // LCD1602 Command Definitions
 #define LCD_CLEAR 0x01          // Clear screen
@@ -17,7 +45,10 @@ sbit LCD_EN = P2 ^ 7; // E: Enable Signal
 #define LCD_DISPLAY_OFF 0x08    // Display off
 #define LCD_CURSOR_ON 0x0E      // Display on, cursor on, no blink
 #define LCD_FUNCTION_SET 0x38   // 8-bit data, 2 lines, 5x7 dots
+#define LCD_FUNCTION_RESET 0x30 // 8-bit data (software reset sequence)
 #define LCD_SET_DDRAM_ADDR 0x80 // Set DDRAM address
+#define LCD_SHIFT_LEFT 0x18     // Shift display left (shows the next line column)
+#define LCD_SHIFT_RIGHT 0x1C    // Shift display right (shows the previous line column)
 
 /**
  * @brief Initialize LCD1602
@@ -25,26 +56,89 @@ sbit LCD_EN = P2 ^ 7; // E: Enable Signal
 void LCD_Init(void);
 
 /**
- * @brief Write command to LCD
+ * @brief Read the busy flag and address counter
+ * @return LCD_BUSY_FLAG if busy, ORed with the address counter
+ */
+unsigned char LCD_ReadStatus(void);
+
+/**
+ * @brief Get the number of status reads that found the controller busy
+ * (each is a few microseconds of waiting)
+ * @return Busy poll count
+ */
+unsigned long LCD_GetBusyCount(void);
+
+/**
+ * @brief Get the number of command and data bytes sent or queued
+ * @return Byte count
+ */
+unsigned long LCD_GetBytesSent(void);
+
+/**
+ * @brief Get the number of writes waiting in the queue for LCD_Tick
+ * @return Queued write count
+ */
+unsigned char LCD_GetQueued(void);
+
+/**
+ * @brief Write command to LCD (waits for the queued writes first)
  * @param cmd Command byte
  */
 void LCD_WriteCmd(unsigned char cmd);
 
 /**
- * @brief Write data to LCD
+ * @brief Write data to LCD (waits for the queued writes first)
  * @param dat Data byte
  */
 void LCD_WriteData(unsigned char dat);
 
+// The Show functions below draw into a shadow framebuffer; LCD_Flush
+// queues the cells that changed and LCD_Tick sends them in the
+// background, so neither waits for the LCD. With the busy flag a tick
+// sends writes for as long as the controller keeps up (up to eight);
+// with fixed delays it sends one.
+
+/**
+ * @brief Send the queued writes the controller is ready for
+ * Called from the system tick
+ */
+void LCD_Tick(void);
+
 /**
- * @brief Set cursor position
+ * @brief Queue the changed cells of the shadow framebuffer for the LCD
+ * Adjacent changed cells are sent after a single address command; cells
+ * that do not fit in the queue are left for the next flush
+ */
+void LCD_Flush(void);
+
+/**
+ * @brief Flush the shadow framebuffer and wait until the LCD shows it
+ * Needs the system tick running
+ */
+void LCD_Sync(void);
+
+/**
+ * @brief Set cursor position (for the Show functions)
  * @param row Row number (0 or 1)
- * @param col Column number (0-15)
+ * @param col Column number (0-15, or line column 0-39 on LCD_SCROLL_ROW)
  */
 void LCD_SetCursor(unsigned char row, unsigned char col);
 
 /**
- * @brief Clear screen
+ * @brief Scroll the display (both rows shift on the LCD; the fixed rows
+ * are redrawn at the new position)
+ * @param shift Line column of LCD_SCROLL_ROW to show in screen column 0
+ */
+void LCD_SetShift(unsigned char shift);
+
+/**
+ * @brief Clear a row of the shadow framebuffer
+ * @param row Row number (0 or 1); clears the whole line of LCD_SCROLL_ROW
+ */
+void LCD_ClearRow(unsigned char row);
+
+/**
+ * @brief Clear screen (immediately, including the shadow framebuffer)
  */
 void LCD_Clear(void);
 
@@ -63,7 +157,7 @@ void LCD_ShowString(unsigned char *str);
 /**
  * @brief Display a character at specified position
  * @param row Row number (0 or 1)
- * @param col Column number (0-15)
+ * @param col Column number (0-15, or line column 0-39 on LCD_SCROLL_ROW)
  * @param c Character to display
  */
 void LCD_ShowCharAt(unsigned char row, unsigned char col, unsigned char c);
@@ -71,7 +165,7 @@ void LCD_ShowCharAt(unsigned char row, unsigned char col, unsigned char c);
 /**
  * @brief Display a string at specified position
  * @param row Row number (0 or 1)
- * @param col Column number (0-15)
+ * @param col Column number (0-15, or line column 0-39 on LCD_SCROLL_ROW)
  * @param str String to display
  */
 void LCD_ShowStringAt(unsigned char row, unsigned char col, unsigned char *str);
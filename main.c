@@ -1,29 +1,53 @@
-#include <reg52.h>
-
+#include "hal.h"
 #include "utils.h"
-#include "delay.h"
 #include "lcd.h"
 #include "keyboard.h"
+#include "timer.h"
+#include "power.h"
 #include "calculator.h"
+#include "uart.h"
+#include "profile.h"
+#include "batch.h"
+
+// The whole expression is kept in the LCD's first line and scrolled with
+// the display shift
+#if MAX_EXPR_LEN > LCD_LINE_LENGTH
+#error "MAX_EXPR_LEN is longer than an LCD line"
+#endif
 
 void main(void)
 {
   unsigned char key;
-  char xdata displayBuffer[17];   // Display window buffer (16 characters + \0)
   char xdata resultBuffer[17];    // Result buffer (16 characters + \0)
   unsigned char scrollOffset = 0; // Current scroll offset
   unsigned char maxScrollOffset;
   unsigned char autoScroll = 1; // Auto scroll to right after input
 
-  // Initialize LCD1602
-  LCD_Init();
-
   // Initialize Keyboard
   Keyboard_Init();
 
+  // Start the system tick (scans the keyboard, times the delays)
+  Timer_Init();
+
+  // Initialize LCD1602
+  LCD_Init();
+
   // Initialize Calculator
   Calculator_Init();
 
+#if UART_ENABLE
+  // Serial port (batch mode, profiler commands)
+  Uart_Init();
+#endif
+
+  // Start the profiler's cycle counter (nothing unless PROFILE_ENABLE)
+  Profile_Init();
+
+#if BATCH_ENABLE
+  // Headless mode: expressions come from the serial port (never returns)
+  Batch_Run();
+#endif
+
   // Clear display
   LCD_ShowStringAt(0, 0, "                ");
   LCD_ShowStringAt(1, 0, "                ");
@@ -33,11 +57,17 @@ void main(void)
   {
     // Scan keyboard
     key = Keyboard_Scan();
-    // No key pressed
+    // No key pressed: update the LCD, then sleep until the next interrupt
+    // (keys typed ahead are all handled before the LCD is updated)
     if (key == KEY_NONE)
     {
+      LCD_Flush();
+      Profile_Poll();
+      Power_Idle();
       continue;
     }
+    Power_Activity();
+    PROFILE_BEGIN(PROFILE_KEY);
 
     // Handle scroll left (K5)
     if (key == KEY_SCROLL_LEFT_CHAR)
@@ -47,9 +77,8 @@ void main(void)
         scrollOffset--;
         autoScroll = 0; // Disable auto scroll
       }
-      // Update display
-      Calculator_GetDisplayWindow(displayBuffer, scrollOffset);
-      LCD_ShowStringAt(0, 0, displayBuffer);
+      // Update display (a single display shift command)
+      LCD_SetShift(scrollOffset);
     }
     // Handle scroll right (K6)
     else if (key == KEY_SCROLL_RIGHT_CHAR)
@@ -60,9 +89,8 @@ void main(void)
         scrollOffset++;
         autoScroll = 0; // Disable auto scroll
       }
-      // Update display
-      Calculator_GetDisplayWindow(displayBuffer, scrollOffset);
-      LCD_ShowStringAt(0, 0, displayBuffer);
+      // Update display (a single display shift command)
+      LCD_SetShift(scrollOffset);
     }
     // Handle backspace
     else if (key == KEY_BACKSPACE_CHAR)
@@ -74,12 +102,17 @@ void main(void)
       maxScrollOffset = Calculator_GetMaxScrollOffset();
       scrollOffset = maxScrollOffset;
 
-      // Update display
-      Calculator_GetDisplayWindow(displayBuffer, scrollOffset);
-      LCD_ShowStringAt(0, 0, displayBuffer);
+      // Update display (only the changed characters reach the LCD)
+      LCD_ClearRow(0);
+      LCD_ShowStringAt(0, 0, Calculator_GetExpression());
+      LCD_SetShift(scrollOffset);
 
-      // Clear second line (result)
+      // Show result preview on second line
       LCD_ShowStringAt(1, 0, "                ");
+      if (Calculator_GetPreview(resultBuffer))
+      {
+        LCD_ShowStringAt(1, 0, resultBuffer);
+      }
     }
     // Handle clear
     else if (key == KEY_CLEAR)
@@ -89,8 +122,9 @@ void main(void)
       autoScroll = 1;
 
       // Clear both lines on LCD
-      LCD_ShowStringAt(0, 0, "                ");
+      LCD_ClearRow(0);
       LCD_ShowStringAt(1, 0, "                ");
+      LCD_SetShift(0);
       LCD_SetCursor(0, 0);
     }
     // Handle equals (evaluate expression)
@@ -115,16 +149,21 @@ void main(void)
         maxScrollOffset = Calculator_GetMaxScrollOffset();
         scrollOffset = maxScrollOffset;
 
-        // Update display with scroll window
-        Calculator_GetDisplayWindow(displayBuffer, scrollOffset);
-        LCD_ShowStringAt(0, 0, displayBuffer);
+        // Update display (only the changed characters reach the LCD)
+        LCD_ClearRow(0);
+        LCD_ShowStringAt(0, 0, Calculator_GetExpression());
+        LCD_SetShift(scrollOffset);
 
-        // Clear second line (prepare to show new result)
+        // Show result preview on second line
         LCD_ShowStringAt(1, 0, "                ");
+        if (Calculator_GetPreview(resultBuffer))
+        {
+          LCD_ShowStringAt(1, 0, resultBuffer);
+        }
       }
       // If input failed (buffer full or invalid char), ignore
     }
 
-    delayMiliseconds(10); // Small delay for main loop
+    PROFILE_END(PROFILE_KEY);
   }
 }
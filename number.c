@@ -0,0 +1,807 @@
+#include "hal.h"
+#include "number.h"
+#include "calculator.h"
+
+// ==================== Result Formatting ====================
+//
+// Results are formatted without sprintf. Each backend turns its value into
+// a non-negative binary integer N = |value| * 10^scale (a "wide" integer of
+// up to WIDE_BYTES bytes), which is converted to decimal digits with the
+// shift-and-add-3 (double dabble) algorithm and then laid out to fit
+// LCD_DISPLAY_WIDTH: decimals are rounded away first, and values whose
+// integer part does not fit are shown as mantissa and exponent (1.2345E20).
+
+// Largest wide integer: the largest float times 10^5 needs 145 bits
+#define WIDE_BYTES 20
+
+// Decimal digits of a WIDE_BYTES integer, plus room for padding
+#define WIDE_DIGITS 50
+
+/**
+ * Convert a wide integer to decimal digits (double dabble)
+ * @param wide Value bytes, least significant first
+ * @param wideLen Number of value bytes
+ * @param digits Digit buffer (WIDE_DIGITS bytes), filled most significant first
+ * @return Number of digits, without leading zeros (0 if value is zero)
+ */
+static unsigned char WideToDigits(unsigned char *wide, unsigned char wideLen, char *digits)
+{
+  unsigned char xdata bcd[WIDE_DIGITS / 2];
+  unsigned char bcdLen = 0;
+  unsigned char i, j, mask;
+  unsigned char b, carry, nextCarry;
+  unsigned char len;
+
+  // Skip leading zero bytes
+  while (wideLen > 0 && wide[wideLen - 1] == 0)
+  {
+    wideLen--;
+  }
+
+  // Shift value bits into the BCD accumulator, most significant first
+  i = wideLen;
+  while (i--)
+  {
+    for (mask = 0x80; mask != 0; mask >>= 1)
+    {
+      carry = (wide[i] & mask) ? 1 : 0;
+      for (j = 0; j < bcdLen; j++)
+      {
+        // Add 3 to every BCD digit >= 5 so it carries correctly when doubled
+        b = bcd[j];
+        if ((b & 0x0F) >= 0x05)
+        {
+          b += 0x03;
+        }
+        if ((b & 0xF0) >= 0x50)
+        {
+          b += 0x30;
+        }
+        nextCarry = b >> 7;
+        bcd[j] = (b << 1) | carry;
+        carry = nextCarry;
+      }
+      if (carry)
+      {
+        bcd[bcdLen++] = 1;
+      }
+    }
+  }
+
+  // Unpack BCD digits, most significant first
+  len = bcdLen * 2;
+  if (len > 0 && (bcd[bcdLen - 1] & 0xF0) == 0)
+  {
+    len--;
+  }
+  for (i = 0; i < len; i++)
+  {
+    b = bcd[i >> 1];
+    digits[len - 1 - i] = '0' + ((i & 1) ? (b >> 4) : (b & 0x0F));
+  }
+
+  return len;
+}
+
+/**
+ * Round a digit string to fewer digits (half away from zero)
+ * @param digits Digit string, most significant first
+ * @param keep Number of digits to keep (less than the current length)
+ * @return New number of digits (keep, or keep + 1 if rounding carried
+ *         into a new leading digit)
+ */
+static unsigned char RoundDigits(char *digits, unsigned char keep)
+{
+  unsigned char i;
+
+  if (digits[keep] < '5')
+  {
+    return keep;
+  }
+
+  i = keep;
+  while (i--)
+  {
+    if (digits[i] != '9')
+    {
+      digits[i]++;
+      return keep;
+    }
+    digits[i] = '0';
+  }
+
+  // All nines: 999 -> 1000
+  for (i = keep; i > 0; i--)
+  {
+    digits[i] = digits[i - 1];
+  }
+  digits[0] = '1';
+  return keep + 1;
+}
+
+/**
+ * Lay out a decimal number for the LCD
+ * @param digits Digits of |value| * 10^scale, most significant first
+ * @param len Number of digits
+ * @param scale Number of digits after the decimal point
+ * @param negative 1 if the value is negative
+ * @param buffer Result string buffer (at least LCD_DISPLAY_WIDTH + 1 bytes)
+ */
+static void FormatDigits(char *digits, unsigned char len, unsigned char scale, unsigned char negative, char *buffer)
+{
+  unsigned char intLen;
+  unsigned char fracLen;
+  unsigned char i;
+  unsigned char exponent;
+
+  // Zero is never negative
+  if (len == 0)
+  {
+    negative = 0;
+  }
+
+  // Pad with leading zeros so there is at least one integer digit
+  while (len <= scale)
+  {
+    for (i = len; i > 0; i--)
+    {
+      digits[i] = digits[i - 1];
+    }
+    digits[0] = '0';
+    len++;
+  }
+  intLen = len - scale;
+
+  if (negative)
+  {
+    *buffer++ = '-';
+  }
+
+  // Fixed notation: integer part, decimal point and at least one decimal
+  if (negative + intLen + 2 <= LCD_DISPLAY_WIDTH)
+  {
+    // Round away decimals that do not fit
+    fracLen = LCD_DISPLAY_WIDTH - negative - intLen - 1;
+    if (fracLen < scale)
+    {
+      len = RoundDigits(digits, intLen + fracLen);
+      intLen = len - fracLen;
+    }
+    else
+    {
+      fracLen = scale;
+    }
+
+    // Remove trailing zeros (keep at least 1 decimal place)
+    while (fracLen > 1 && digits[intLen + fracLen - 1] == '0')
+    {
+      fracLen--;
+    }
+
+    // Rounding may have carried into one more integer digit
+    if (negative + intLen + 2 <= LCD_DISPLAY_WIDTH)
+    {
+      for (i = 0; i < intLen; i++)
+      {
+        *buffer++ = digits[i];
+      }
+      *buffer++ = '.';
+      for (i = 0; i < fracLen; i++)
+      {
+        *buffer++ = digits[intLen + i];
+      }
+      *buffer = '\0';
+      return;
+    }
+  }
+
+  // Scientific notation: d.ddddE<exponent>
+  // The integer part did not fit, so the exponent always has two digits
+  exponent = intLen - 1;
+  fracLen = LCD_DISPLAY_WIDTH - negative - 5;
+  if (len > fracLen + 1)
+  {
+    len = RoundDigits(digits, fracLen + 1);
+    exponent += len - (fracLen + 1);
+  }
+
+  // Remove trailing zeros (keep at least 1 decimal place)
+  fracLen = len - 1;
+  while (fracLen > 1 && digits[fracLen] == '0')
+  {
+    fracLen--;
+  }
+
+  *buffer++ = digits[0];
+  *buffer++ = '.';
+  for (i = 1; i <= fracLen; i++)
+  {
+    *buffer++ = digits[i];
+  }
+  if (fracLen == 0)
+  {
+    *buffer++ = '0';
+  }
+  *buffer++ = 'E';
+  *buffer++ = '0' + exponent / 10;
+  *buffer++ = '0' + exponent % 10;
+  *buffer = '\0';
+}
+
+#if NUMBER_BACKEND == NUMBER_BACKEND_FIXED
+
+// ==================== Fixed Point Backend ====================
+//
+// Values are signed 32-bit integers scaled by NUMBER_SCALE. Multiplication
+// and division work on magnitudes with a 64-bit intermediate kept as a
+// little-endian byte array: partial products are 8x8 bit multiplies and
+// the rescaling divides by 10 one nibble at a time, so the compiler can use
+// MUL AB and DIV AB instead of the 32-bit library routines.
+
+/**
+ * Multiply two 32-bit magnitudes into a 64-bit product
+ * @param product Product bytes, least significant first (8 bytes)
+ */
+static void MulWide(unsigned long operand1, unsigned long operand2, unsigned char *product)
+{
+  unsigned char a[4];
+  unsigned char b[4];
+  unsigned char i, j;
+  unsigned char carry;
+  unsigned int partial;
+
+  for (i = 0; i < 4; i++)
+  {
+    a[i] = (unsigned char)operand1;
+    b[i] = (unsigned char)operand2;
+    operand1 >>= 8;
+    operand2 >>= 8;
+  }
+
+  for (i = 0; i < 8; i++)
+  {
+    product[i] = 0;
+  }
+
+  for (i = 0; i < 4; i++)
+  {
+    if (a[i] == 0)
+    {
+      continue;
+    }
+
+    carry = 0;
+    for (j = 0; j < 4; j++)
+    {
+      // 255 * 255 + 255 + 255 still fits in 16 bits
+      partial = (unsigned int)a[i] * b[j] + product[i + j] + carry;
+      product[i + j] = (unsigned char)partial;
+      carry = (unsigned char)(partial >> 8);
+    }
+    product[i + 4] = carry;
+  }
+}
+
+/**
+ * Divide a 64-bit value by 10 in place
+ * @param value Value bytes, least significant first (8 bytes)
+ * @return Remainder (0-9)
+ */
+static unsigned char DivWideBy10(unsigned char *value)
+{
+  unsigned char i;
+  unsigned char rem = 0;
+  unsigned char hi, lo;
+
+  i = 8;
+  while (i--)
+  {
+    // rem < 10, so rem * 16 + nibble always fits in 8 bits
+    hi = (unsigned char)(rem * 16 + (value[i] >> 4));
+    rem = hi % 10;
+    hi = hi / 10;
+    lo = (unsigned char)(rem * 16 + (value[i] & 0x0F));
+    rem = lo % 10;
+    lo = lo / 10;
+    value[i] = (hi << 4) | lo;
+  }
+
+  return rem;
+}
+
+/**
+ * Convert the low 4 bytes of a 64-bit value to a magnitude
+ * @return 1=success, 0=failure (does not fit in NUMBER_MAX)
+ */
+static unsigned char NarrowWide(unsigned char *value, unsigned long *result)
+{
+  unsigned char i;
+
+  if (value[4] | value[5] | value[6] | value[7])
+  {
+    return 0;
+  }
+
+  *result = 0;
+  for (i = 4; i > 0; i--)
+  {
+    *result = (*result << 8) | value[i - 1];
+  }
+
+  return *result <= NUMBER_MAX;
+}
+
+/**
+ * Get the magnitude of a number
+ */
+static unsigned long Magnitude(Number value)
+{
+  return value < 0 ? (unsigned long)-value : (unsigned long)value;
+}
+
+void Number_BuildBegin(NumberBuilder *builder)
+{
+  builder->value = 0;
+  builder->weight = NUMBER_SCALE / 10;
+  builder->overflow = 0;
+  builder->dropped = 0;
+  builder->inexact = 0;
+}
+
+void Number_BuildDigit(NumberBuilder *builder, unsigned char digit, unsigned char afterDot)
+{
+  if (!afterDot)
+  {
+    if (builder->value > (NUMBER_MAX - digit * NUMBER_SCALE) / 10)
+    {
+      builder->overflow = 1;
+      return;
+    }
+    builder->value = builder->value * 10 + digit * NUMBER_SCALE;
+  }
+  else if (builder->weight == 0)
+  {
+    // Digits beyond NUMBER_FRAC_DIGITS are dropped, rounding half up on
+    // the first of them
+    if (!builder->dropped && digit >= 5)
+    {
+      if (builder->value == NUMBER_MAX)
+      {
+        builder->overflow = 1;
+        return;
+      }
+      builder->value++;
+    }
+    builder->dropped = 1;
+    if (digit != 0)
+    {
+      builder->inexact = 1;
+    }
+  }
+  else
+  {
+    if (builder->value > NUMBER_MAX - digit * builder->weight)
+    {
+      builder->overflow = 1;
+      return;
+    }
+    builder->value += digit * builder->weight;
+    builder->weight /= 10;
+  }
+}
+
+unsigned char Number_BuildEnd(NumberBuilder *builder, unsigned char negative, Number *value)
+{
+  // A non-zero literal must not turn into a zero divisor
+  if (builder->overflow || (builder->value == 0 && builder->inexact))
+  {
+    return 0;
+  }
+
+  *value = negative ? -builder->value : builder->value;
+  return 1;
+}
+
+unsigned char Number_Add(Number operand1, Number operand2, Number *result)
+{
+  if ((operand2 > 0 && operand1 > NUMBER_MAX - operand2) ||
+      (operand2 < 0 && operand1 < -NUMBER_MAX - operand2))
+  {
+    return 0;
+  }
+
+  *result = operand1 + operand2;
+  return 1;
+}
+
+unsigned char Number_Sub(Number operand1, Number operand2, Number *result)
+{
+  if ((operand2 < 0 && operand1 > NUMBER_MAX + operand2) ||
+      (operand2 > 0 && operand1 < -NUMBER_MAX + operand2))
+  {
+    return 0;
+  }
+
+  *result = operand1 - operand2;
+  return 1;
+}
+
+unsigned char Number_Mul(Number operand1, Number operand2, Number *result)
+{
+  unsigned char product[8];
+  unsigned char i;
+  unsigned char rem = 0;
+  unsigned long magnitude;
+
+  MulWide(Magnitude(operand1), Magnitude(operand2), product);
+
+  // Rescale, rounding half away from zero on the last removed digit
+  for (i = 0; i < NUMBER_FRAC_DIGITS; i++)
+  {
+    rem = DivWideBy10(product);
+  }
+
+  if (!NarrowWide(product, &magnitude))
+  {
+    return 0;
+  }
+  if (rem >= 5)
+  {
+    if (magnitude == NUMBER_MAX)
+    {
+      return 0;
+    }
+    magnitude++;
+  }
+
+  *result = ((operand1 < 0) != (operand2 < 0)) ? -(Number)magnitude : (Number)magnitude;
+  return 1;
+}
+
+unsigned char Number_Div(Number operand1, Number operand2, Number *result)
+{
+  unsigned char dividend[8];
+  unsigned long divisor = Magnitude(operand2);
+  unsigned long quotient = 0;
+  unsigned long rem = 0;
+  unsigned char i, mask;
+
+  // Scale the dividend up so the quotient keeps its decimal places
+  MulWide(Magnitude(operand1), NUMBER_SCALE, dividend);
+
+  // Binary long division, most significant bit first. DIV AB is no help
+  // here: it divides by an 8-bit value, and the divisor is a full 31-bit
+  // magnitude, so a digit-at-a-time divide would still need a 32-bit
+  // trial quotient and multiply-subtract for every digit.
+  // rem < divisor <= NUMBER_MAX, so rem << 1 never overflows 32 bits
+  i = 8;
+  while (i--)
+  {
+    for (mask = 0x80; mask != 0; mask >>= 1)
+    {
+      if (quotient > (NUMBER_MAX >> 1))
+      {
+        return 0;
+      }
+      quotient <<= 1;
+      rem <<= 1;
+      if (dividend[i] & mask)
+      {
+        rem |= 1;
+      }
+      if (rem >= divisor)
+      {
+        rem -= divisor;
+        quotient |= 1;
+      }
+    }
+  }
+
+  // Round half away from zero
+  if (rem >= divisor - rem)
+  {
+    if (quotient == NUMBER_MAX)
+    {
+      return 0;
+    }
+    quotient++;
+  }
+
+  *result = ((operand1 < 0) != (operand2 < 0)) ? -(Number)quotient : (Number)quotient;
+  return 1;
+}
+
+unsigned char Number_IsZero(Number value)
+{
+  return value == 0;
+}
+
+void Number_ToString(Number value, char *buffer)
+{
+  unsigned long magnitude = Magnitude(value);
+  unsigned char wide[4];
+  char xdata digits[WIDE_DIGITS];
+  unsigned char i;
+  unsigned char len;
+
+  for (i = 0; i < 4; i++)
+  {
+    wide[i] = (unsigned char)magnitude;
+    magnitude >>= 8;
+  }
+
+  len = WideToDigits(wide, 4, digits);
+  FormatDigits(digits, len, NUMBER_FRAC_DIGITS, value < 0, buffer);
+}
+
+#else
+
+// ==================== Float Backend ====================
+
+// Access to the IEEE 754 bit pattern of a float
+// (C51 stores float and long with the same byte order)
+typedef union
+{
+  float value;
+  unsigned long raw;
+} FloatBits;
+
+/**
+ * Multiply a wide integer by a small factor in place
+ * @param wide Value bytes, least significant first
+ * @param len Number of value bytes
+ * @param factor Factor (fits in 8 bits, uses MUL AB)
+ * @return New number of value bytes
+ */
+static unsigned char WideMulSmall(unsigned char *wide, unsigned char len, unsigned char factor)
+{
+  unsigned char i;
+  unsigned char carry = 0;
+  unsigned int partial;
+
+  for (i = 0; i < len; i++)
+  {
+    partial = (unsigned int)wide[i] * factor + carry;
+    wide[i] = (unsigned char)partial;
+    carry = (unsigned char)(partial >> 8);
+  }
+  if (carry)
+  {
+    wide[len++] = carry;
+  }
+
+  return len;
+}
+
+/**
+ * Shift a wide integer left in place
+ * @param wide Value bytes, least significant first
+ * @param len Number of value bytes
+ * @param count Number of bits to shift
+ * @return New number of value bytes
+ */
+static unsigned char WideShiftLeft(unsigned char *wide, unsigned char len, unsigned char count)
+{
+  unsigned char bytes = count >> 3;
+  unsigned char bits = count & 7;
+  unsigned char i;
+  unsigned char carry = 0;
+
+  if (len == 0)
+  {
+    return 0;
+  }
+
+  // Whole bytes
+  if (bytes > 0)
+  {
+    i = len;
+    while (i--)
+    {
+      wide[i + bytes] = wide[i];
+    }
+    for (i = 0; i < bytes; i++)
+    {
+      wide[i] = 0;
+    }
+    len += bytes;
+  }
+
+  // Remaining bits
+  if (bits > 0)
+  {
+    for (i = 0; i < len; i++)
+    {
+      unsigned char b = wide[i];
+      wide[i] = (b << bits) | carry;
+      carry = b >> (8 - bits);
+    }
+    if (carry)
+    {
+      wide[len++] = carry;
+    }
+  }
+
+  return len;
+}
+
+/**
+ * Shift a wide integer right in place, rounding half up
+ * @param wide Value bytes, least significant first
+ * @param len Number of value bytes
+ * @param count Number of bits to shift (at least 1)
+ * @return New number of value bytes
+ */
+static unsigned char WideShiftRightRound(unsigned char *wide, unsigned char len, unsigned int count)
+{
+  unsigned char bytes;
+  unsigned char bits;
+  unsigned char roundUp;
+  unsigned char i;
+
+  // Everything including the rounding bit is shifted out
+  if (count > (unsigned int)len * 8)
+  {
+    return 0;
+  }
+
+  // Highest bit shifted out decides rounding
+  roundUp = (wide[(count - 1) >> 3] >> ((count - 1) & 7)) & 1;
+
+  // Whole bytes
+  bytes = count >> 3;
+  bits = count & 7;
+  for (i = 0; i + bytes < len; i++)
+  {
+    wide[i] = wide[i + bytes];
+  }
+  len -= bytes;
+
+  // Remaining bits
+  if (bits > 0)
+  {
+    for (i = 0; i < len; i++)
+    {
+      wide[i] >>= bits;
+      if (i + 1 < len)
+      {
+        wide[i] |= wide[i + 1] << (8 - bits);
+      }
+    }
+  }
+
+  // Round
+  if (roundUp)
+  {
+    for (i = 0; i < len; i++)
+    {
+      if (++wide[i] != 0)
+      {
+        break;
+      }
+    }
+    if (i == len)
+    {
+      wide[len++] = 1;
+    }
+  }
+
+  return len;
+}
+
+void Number_BuildBegin(NumberBuilder *builder)
+{
+  builder->intPart = 0.0;
+  builder->fracPart = 0.0;
+  builder->divisor = 10.0;
+}
+
+void Number_BuildDigit(NumberBuilder *builder, unsigned char digit, unsigned char afterDot)
+{
+  if (!afterDot)
+  {
+    builder->intPart = builder->intPart * 10.0 + digit;
+  }
+  else
+  {
+    builder->fracPart = builder->fracPart + digit / builder->divisor;
+    builder->divisor *= 10.0;
+  }
+}
+
+/**
+ * Store a result unless it overflowed
+ * The float library returns infinity (or NaN) for results beyond the
+ * largest float
+ * @param value Result to store
+ * @param result Pointer to store the value
+ * @return 1=success, 0=failure (value is infinite or NaN)
+ */
+static unsigned char StoreFinite(float value, Number *result)
+{
+  FloatBits bits;
+
+  bits.value = value;
+  if ((unsigned char)(bits.raw >> 23) == 0xFF)
+  {
+    return 0;
+  }
+
+  *result = value;
+  return 1;
+}
+
+unsigned char Number_BuildEnd(NumberBuilder *builder, unsigned char negative, Number *value)
+{
+  float magnitude = builder->intPart + builder->fracPart;
+
+  return StoreFinite(negative ? -magnitude : magnitude, value);
+}
+
+unsigned char Number_Add(Number operand1, Number operand2, Number *result)
+{
+  return StoreFinite(operand1 + operand2, result);
+}
+
+unsigned char Number_Sub(Number operand1, Number operand2, Number *result)
+{
+  return StoreFinite(operand1 - operand2, result);
+}
+
+unsigned char Number_Mul(Number operand1, Number operand2, Number *result)
+{
+  return StoreFinite(operand1 * operand2, result);
+}
+
+unsigned char Number_Div(Number operand1, Number operand2, Number *result)
+{
+  return StoreFinite(operand1 / operand2, result);
+}
+
+unsigned char Number_IsZero(Number value)
+{
+  return value == 0.0 || value == -0.0;
+}
+
+void Number_ToString(Number value, char *buffer)
+{
+  FloatBits bits;
+  unsigned char biased;
+  int shift;
+  unsigned char xdata wide[WIDE_BYTES];
+  char xdata digits[WIDE_DIGITS];
+  unsigned char len;
+
+  bits.value = value;
+  biased = (unsigned char)(bits.raw >> 23);
+
+  // |value| = mantissa * 2^shift (zero and denormals are shown as zero)
+  len = 0;
+  if (biased != 0)
+  {
+    bits.raw |= 0x800000L;
+    wide[0] = (unsigned char)bits.raw;
+    wide[1] = (unsigned char)(bits.raw >> 8);
+    wide[2] = (unsigned char)(bits.raw >> 16);
+    len = 3;
+  }
+  shift = (int)biased - 150;
+
+  // Scale to 5 decimal places and round to an integer
+  len = WideMulSmall(wide, len, 100);
+  len = WideMulSmall(wide, len, 100);
+  len = WideMulSmall(wide, len, 10);
+  if (shift >= 0)
+  {
+    len = WideShiftLeft(wide, len, shift);
+  }
+  else
+  {
+    len = WideShiftRightRound(wide, len, -shift);
+  }
+
+  len = WideToDigits(wide, len, digits);
+  FormatDigits(digits, len, 5, (bits.raw & 0x80000000L) != 0, buffer);
+}
+
+#endif
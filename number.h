@@ -0,0 +1,125 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+// ==================== Numeric Backend Selection ====================
+
+// Available numeric backends
+#define NUMBER_BACKEND_FLOAT 0 // C51 software float (default)
+#define NUMBER_BACKEND_FIXED 1 // Scaled 32-bit integer (decimal fixed point)
+
+// Select the backend at compile time, e.g. NUMBER_BACKEND=1 in the
+// project's C51 "Define" field
+#ifndef NUMBER_BACKEND
+#define NUMBER_BACKEND NUMBER_BACKEND_FLOAT
+#endif
+
+#if NUMBER_BACKEND == NUMBER_BACKEND_FIXED
+
+// Number of decimal places kept by the fixed point backend (1-4)
+// Range is +/-(2^31 - 1) / 10^NUMBER_FRAC_DIGITS:
+//   1  +/-214748364.7
+//   2  +/-21474836.47
+//   3  +/-2147483.647 (default)
+//   4  +/-214748.3647
+#ifndef NUMBER_FRAC_DIGITS
+#define NUMBER_FRAC_DIGITS 3
+#endif
+
+#if NUMBER_FRAC_DIGITS == 1
+#define NUMBER_SCALE 10L
+#elif NUMBER_FRAC_DIGITS == 2
+#define NUMBER_SCALE 100L
+#elif NUMBER_FRAC_DIGITS == 3
+#define NUMBER_SCALE 1000L
+#elif NUMBER_FRAC_DIGITS == 4
+#define NUMBER_SCALE 10000L
+#else
+#error "NUMBER_FRAC_DIGITS must be 1-4"
+#endif
+
+// Largest representable magnitude (raw value)
+#define NUMBER_MAX 0x7FFFFFFFL
+
+// Value scaled by NUMBER_SCALE (1.5 is stored as 1500)
+typedef long Number;
+
+// Number being built from its decimal digits
+typedef struct
+{
+  Number value;           // Accumulated magnitude
+  Number weight;          // Weight of the next fractional digit
+  unsigned char overflow; // Set if the digits exceed the range
+  unsigned char dropped;  // Set once a digit beyond NUMBER_FRAC_DIGITS is seen
+  unsigned char inexact;  // Set if a dropped digit is not zero
+} NumberBuilder;
+
+#else
+
+typedef float Number;
+
+// Number being built from its decimal digits
+typedef struct
+{
+  float intPart;  // Integer part
+  float fracPart; // Fractional part
+  float divisor;  // Weight of the next fractional digit (10, 100, ...)
+} NumberBuilder;
+
+#endif
+
+// ==================== Number Parsing ====================
+
+/**
+ * Start building a number from decimal digits
+ * @param builder Builder to reset
+ */
+void Number_BuildBegin(NumberBuilder *builder);
+
+/**
+ * Append a decimal digit
+ * @param builder Builder
+ * @param digit Digit value (0-9)
+ * @param afterDot 1 if the digit follows the decimal point, 0 otherwise
+ */
+void Number_BuildDigit(NumberBuilder *builder, unsigned char digit, unsigned char afterDot);
+
+/**
+ * Finish building a number
+ * A non-zero number too small for the backend (0.0001 with 3 fixed point
+ * decimals) is out of range rather than zero
+ * @param builder Builder
+ * @param negative 1 to negate the value
+ * @param value Pointer to store the value
+ * @return 1=success, 0=failure (value out of range)
+ */
+unsigned char Number_BuildEnd(NumberBuilder *builder, unsigned char negative, Number *value);
+
+// ==================== Arithmetic ====================
+// All operations return 1=success, 0=failure (result out of range)
+
+unsigned char Number_Add(Number operand1, Number operand2, Number *result);
+unsigned char Number_Sub(Number operand1, Number operand2, Number *result);
+unsigned char Number_Mul(Number operand1, Number operand2, Number *result);
+
+/**
+ * Divide two numbers
+ * The divisor must not be zero (see Number_IsZero)
+ */
+unsigned char Number_Div(Number operand1, Number operand2, Number *result);
+
+/**
+ * Check if a number is zero
+ * @return 1 if zero, 0 otherwise
+ */
+unsigned char Number_IsZero(Number value);
+
+// ==================== Formatting ====================
+
+/**
+ * Convert number to string (trailing zeros removed, at least 1 decimal place)
+ * @param value Number to convert
+ * @param buffer Result string buffer (at least 17 bytes, including \0)
+ */
+void Number_ToString(Number value, char *buffer);
+
+#endif // NUMBER_H
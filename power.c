@@ -0,0 +1,156 @@
+#include "power.h"
+#include "timer.h"
+#include "keyboard.h"
+#include "uart.h"
+
+// Tick of the last key press
+static unsigned int lastActivity = 0;
+
+// Machine cycles per system tick (Timer0 counts from TICK_RELOAD to the
+// overflow)
+#define TICK_CYCLES (65536UL - TICK_RELOAD)
+
+// Set while the main loop sleeps in idle mode, with the Timer0 count at
+// which it went to sleep
+static bit idleFlag = 0;
+static unsigned int idleStart;
+
+// Duty cycle counters: ticks since reset and machine cycles spent in idle
+// mode (both wrap around)
+static unsigned long tickCount = 0;
+static unsigned long idleCycles = 0;
+
+/**
+ * @brief Restart the inactivity timeout (call on every key press)
+ */
+void Power_Activity(void)
+{
+  lastActivity = Timer_GetTicks();
+}
+
+#if !UART_ENABLE
+/**
+ * @brief Enter power-down until a key on INT0/INT1 is pressed
+ */
+static void PowerDown(void)
+{
+  // Level triggered external interrupts wake the chip
+  IT0 = 0;
+  IT1 = 0;
+  EX0 = 1;
+  EX1 = 1;
+
+  PCON |= PCON_PD;
+  _nop_(); // First instruction after wake-up
+
+  EX0 = 0;
+  EX1 = 0;
+
+  // The key that woke the chip is still down; do not report it
+  Keyboard_Resync();
+}
+#endif
+
+/**
+ * @brief Read the running Timer0
+ * @return Timer0 count (TH0 read again in case TL0 carried into it)
+ */
+static unsigned int ReadTimer0(void)
+{
+  unsigned char high, low;
+
+  do
+  {
+    high = TH0;
+    low = TL0;
+  } while (high != TH0);
+
+  return ((unsigned int)high << 8) | low;
+}
+
+/**
+ * @brief Sleep until the next interrupt
+ */
+void Power_Idle(void)
+{
+  unsigned int now;
+
+#if !UART_ENABLE
+  if (Timer_GetTicks() - lastActivity >= POWER_DOWN_TIMEOUT_MS / TICK_MS)
+  {
+    PowerDown();
+    Power_Activity();
+    return;
+  }
+#endif
+
+  // Note where idle mode starts. The tick is held off meanwhile; if it is
+  // already due, it would end idle mode at once, so do not sleep.
+  ET0 = 0;
+  idleStart = ReadTimer0();
+  if (TF0)
+  {
+    ET0 = 1;
+    return;
+  }
+  idleFlag = 1;
+  ET0 = 1;
+  PCON |= PCON_IDL;
+
+  // Woken by another interrupt than the tick: idle mode ended now (the
+  // waking handler's own cycles are counted as idle). If the tick ended
+  // it, Power_Tick has counted the idle time already.
+  ET0 = 0;
+  now = ReadTimer0();
+  if (idleFlag && !TF0)
+  {
+    idleFlag = 0;
+    idleCycles += now - idleStart;
+  }
+  ET0 = 1;
+}
+
+/**
+ * @brief Count the tick, and the idle time it ended
+ */
+void Power_Tick(void)
+{
+  tickCount++;
+  if (idleFlag)
+  {
+    // Idle from idleStart to the overflow that raised this tick
+    idleFlag = 0;
+    idleCycles += 65536UL - idleStart;
+  }
+}
+
+/**
+ * @brief Get the duty cycle counters
+ * @param active Pointer to store the machine cycles the CPU was busy
+ * @param idle Pointer to store the machine cycles spent in idle mode
+ */
+void Power_GetStats(unsigned long *active, unsigned long *idle)
+{
+  ET0 = 0; // Read both counters from the same tick
+  *idle = idleCycles;
+  *active = tickCount * TICK_CYCLES - idleCycles;
+  ET0 = 1;
+}
+
+/**
+ * @brief INT0 interrupt: wake-up from power-down
+ * The interrupt is level triggered, so it is disabled until the next
+ * power-down
+ */
+HAL_ISR(Power_Int0_ISR, 0)
+{
+  EX0 = 0;
+}
+
+/**
+ * @brief INT1 interrupt: wake-up from power-down
+ */
+HAL_ISR(Power_Int1_ISR, 2)
+{
+  EX1 = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include "hal.h"
+
+// Power-down after this long without a key press (at most 65535 ms)
+#ifndef POWER_DOWN_TIMEOUT_MS
+#define POWER_DOWN_TIMEOUT_MS 60000
+#endif
+
+// PCON bits
+#define PCON_IDL 0x01 // Idle mode
+#define PCON_PD 0x02  // Power-down mode
+
+/**
+ * @brief Restart the inactivity timeout (call on every key press)
+ */
+void Power_Activity(void);
+
+/**
+ * @brief Sleep until the next interrupt (call when the main loop has
+ * nothing to do)
+ * Enters idle mode, which the next system tick ends. After
+ * POWER_DOWN_TIMEOUT_MS without activity it enters power-down instead,
+ * which is left through INT0 or INT1 (the ')' and backspace keys on P3.2
+ * and P3.3). RAM, the port levels and the LCD contents are kept.
+ * Leaving power-down through an interrupt needs a chip that supports it
+ * (e.g. AT89S52); the original AT89C51 only leaves it through reset.
+ * Builds with UART_ENABLE=1 never power down: the serial port stops with
+ * the oscillator.
+ */
+void Power_Idle(void);
+
+/**
+ * @brief Count the tick, and the idle time it ended
+ * Called from the Timer0 system tick, see timer.c
+ */
+void Power_Tick(void);
+
+/**
+ * @brief Get the duty cycle counters
+ * Both are machine cycles measured with Timer0 (idle mode is entered and
+ * left at a timer count), summed over whole ticks since reset. They wrap
+ * around after 2^32 cycles (about 36 minutes at 2 MHz), so use the
+ * difference between two reads.
+ * @param active Pointer to store the machine cycles the CPU was busy
+ * @param idle Pointer to store the machine cycles spent in idle mode
+ */
+void Power_GetStats(unsigned long *active, unsigned long *idle);
+
+/**
+ * @brief INT0 and INT1 interrupts: wake-up from power-down
+ */
+HAL_ISR(Power_Int0_ISR, 0);
+HAL_ISR(Power_Int1_ISR, 2);
+
+#endif // POWER_H
@@ -0,0 +1,118 @@
+#include "profile.h"
+
+#if PROFILE_ENABLE
+
+ProfileSection xdata profileSections[PROFILE_SECTION_COUNT];
+
+// Section names in the dump, in section order
+static char code *code profileNames[PROFILE_SECTION_COUNT] = {
+    "key", "parse", "apply", "finish", "format", "lcd_draw", "key_tick", "lcd_tick"};
+
+// Cycles an empty BEGIN/END pair measures
+static unsigned int profileOverhead = 0;
+
+/**
+ * @brief Clear the accumulators
+ */
+static void Profile_Reset(void)
+{
+  unsigned char i;
+
+  EA = 0; // The system tick updates its sections too
+  for (i = 0; i < PROFILE_SECTION_COUNT; i++)
+  {
+    profileSections[i].calls = 0;
+    profileSections[i].total = 0;
+    profileSections[i].max = 0;
+  }
+  EA = 1;
+}
+
+/**
+ * @brief Start Timer2 as the cycle counter and clear the accumulators
+ */
+void Profile_Init(void)
+{
+  // 16-bit auto-reload mode with a reload of 0: counts every machine
+  // cycle and wraps at 65536 (no interrupt)
+  T2CON = 0x00;
+  RCAP2H = 0;
+  RCAP2L = 0;
+  TH2 = 0;
+  TL2 = 0;
+  TR2 = 1;
+
+  // Measure the markers themselves on the first section
+  Profile_Reset();
+  EA = 0;
+  PROFILE_BEGIN(PROFILE_KEY);
+  PROFILE_END(PROFILE_KEY);
+  profileOverhead = profileSections[PROFILE_KEY].max;
+
+  Profile_Reset();
+}
+
+/**
+ * @brief Send the accumulators as CSV lines
+ */
+static void Profile_Dump(void)
+{
+  ProfileSection section;
+  unsigned char i;
+
+  Uart_PutString("section,calls,total,max\n");
+  for (i = 0; i < PROFILE_SECTION_COUNT; i++)
+  {
+    // Copy at once, the system tick may update the section
+    EA = 0;
+    section = profileSections[i];
+    EA = 1;
+
+    Uart_PutString(profileNames[i]);
+    Uart_PutChar(',');
+    Uart_PutNumber(section.calls);
+    Uart_PutChar(',');
+    Uart_PutNumber(section.total);
+    Uart_PutChar(',');
+    Uart_PutNumber(section.max);
+    Uart_PutChar('\n');
+  }
+  Uart_PutString("overhead,");
+  Uart_PutNumber(profileOverhead);
+  Uart_PutChar('\n');
+}
+
+/**
+ * @brief Handle a profiler command
+ * @param command Command byte
+ * @return 1=command handled, 0=not a profiler command
+ */
+unsigned char Profile_Command(char command)
+{
+  if (command == 'p')
+  {
+    Profile_Dump();
+    return 1;
+  }
+  if (command == 'r')
+  {
+    Profile_Reset();
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Handle profiler commands received over the serial port
+ */
+void Profile_Poll(void)
+{
+  char command;
+
+  while (Uart_GetChar(&command))
+  {
+    Profile_Command(command);
+  }
+}
+
+#endif // PROFILE_ENABLE
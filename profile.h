@@ -0,0 +1,118 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "hal.h"
+
+// ==================== Hot Path Profiler ====================
+// PROFILE_BEGIN(section) and PROFILE_END(section) bracket a piece of code;
+// the cycles in between are read from Timer2, which runs free as a 16-bit
+// machine cycle counter. Each section accumulates its number of calls,
+// its total and its longest run. Times include nested sections and the
+// interrupts taken meanwhile, and a run longer than 65535 cycles (32 ms
+// at 24 MHz) wraps.
+//
+// The accumulators are sent over the serial port on request (see
+// Profile_Poll), so a profiling build needs UART_ENABLE=1 as well. With
+// PROFILE_ENABLE=0 the markers compile to nothing and Timer2 stays free.
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE 0
+#endif
+
+// Sections
+#define PROFILE_KEY 0       // Main loop handling of one key press
+#define PROFILE_PARSE 1     // ParseChar: tokenizer and shunting yard for one character
+#define PROFILE_APPLY 2     // One arithmetic operation of ApplyOperator
+#define PROFILE_FINISH 3    // FinishExpression for the preview of the whole expression
+#define PROFILE_FORMAT 4    // Number_ToString of a result
+#define PROFILE_LCD_DRAW 5  // LCD_Flush: shadow framebuffer to the write queue
+#define PROFILE_KEY_TICK 6  // Keyboard_Tick in the system tick (key sampling)
+#define PROFILE_LCD_TICK 7  // LCD_Tick in the system tick (queued bus writes)
+#define PROFILE_SECTION_COUNT 8
+
+#if PROFILE_ENABLE
+
+#include "uart.h"
+
+#if !defined(__C51__) && !defined(__SDCC)
+#error "PROFILE_ENABLE needs the 8052 Timer2"
+#endif
+#if !UART_ENABLE
+#error "PROFILE_ENABLE needs UART_ENABLE=1 to send the accumulators"
+#endif
+
+// Accumulators of a section
+typedef struct
+{
+  unsigned int start;  // Timer2 count at PROFILE_BEGIN
+  unsigned long calls; // Completed runs
+  unsigned long total; // Cycles of all runs
+  unsigned int max;    // Cycles of the longest run
+} ProfileSection;
+
+extern ProfileSection xdata profileSections[PROFILE_SECTION_COUNT];
+
+// Read the Timer2 count (TH2 again in case TL2 wrapped in between)
+// The markers are macros rather than functions so the system tick
+// interrupt can use them too without sharing a function's data with the
+// main loop.
+#define PROFILE_READ(count)                             \
+  do                                                    \
+  {                                                     \
+    unsigned char profileHigh;                          \
+    do                                                  \
+    {                                                   \
+      profileHigh = TH2;                                \
+      (count) = ((unsigned int)profileHigh << 8) | TL2; \
+    } while (profileHigh != TH2);                       \
+  } while (0)
+
+#define PROFILE_BEGIN(section) PROFILE_READ(profileSections[section].start)
+
+#define PROFILE_END(section)                                      \
+  do                                                              \
+  {                                                               \
+    unsigned int profileCycles;                                   \
+    PROFILE_READ(profileCycles);                                  \
+    profileCycles -= profileSections[section].start;              \
+    profileSections[section].calls++;                             \
+    profileSections[section].total += profileCycles;              \
+    if (profileCycles > profileSections[section].max)             \
+    {                                                             \
+      profileSections[section].max = profileCycles;               \
+    }                                                             \
+  } while (0)
+
+/**
+ * @brief Start Timer2 as the cycle counter and clear the accumulators
+ * Needs the serial port started already (see Uart_Init)
+ */
+void Profile_Init(void);
+
+/**
+ * @brief Handle a profiler command
+ * Commands (one byte each):
+ *   'p'  send the accumulators as CSV lines "<section>,<calls>,<total>,<max>"
+ *        after a header line, followed by "overhead,<cycles>", the cycles
+ *        an empty BEGIN/END pair adds to a run
+ *   'r'  clear the accumulators
+ * @param command Command byte
+ * @return 1=command handled, 0=not a profiler command
+ */
+unsigned char Profile_Command(char command);
+
+/**
+ * @brief Handle profiler commands received over the serial port
+ * Call from the main loop; bytes that are not commands are ignored
+ */
+void Profile_Poll(void);
+
+#else
+
+#define PROFILE_BEGIN(section)
+#define PROFILE_END(section)
+#define Profile_Init()
+#define Profile_Poll()
+
+#endif // PROFILE_ENABLE
+
+#endif // PROFILE_H
@@ -0,0 +1,160 @@
+// Cycle benchmark for the calculator and the LCD routines, run under the
+// ucsim s51 simulator (see Makefile). Timer2 counts machine cycles; the
+// results are written to the serial port as CSV lines:
+//   <expression index>,<stage>,<cycles>  one per expression and stage
+//   total,<stage>,<cycles>               sum over the corpus
+//   max,<stage>,<cycles>                 worst expression
+//   max,stack_arena,<bytes>              peak use of the stack arena
+//
+// Stages:
+//   input     Calculator_InputChar for every character (tokenizer,
+//             shunting yard and evaluation run incrementally per key)
+//   format    Calculator_GetPreview (Number_ToString of the preview)
+//   evaluate  Calculator_Evaluate (finishing the expression, formatting)
+//   lcd_draw  drawing both rows into the shadow framebuffer (with the
+//             display shift for long expressions) + LCD_Flush
+//   lcd_send  LCD_Tick until the queue is empty (the bus transfers)
+
+#include "hal.h"
+#include "calculator.h"
+#include "stack.h"
+#include "lcd.h"
+#include "simio.h"
+#include "cycles.h"
+
+// ==================== Corpus ====================
+// Worst-case nesting, long numbers, division chains and error cases; each
+// expression fits in MAX_EXPR_LEN
+
+static char code *code corpus[] = {
+    "1+2",
+    "3+4*2",
+    "(((((((((((((((1)))))))))))))))",
+    "(((((1+2)*3+4)*5+6)*7+8)*9+1)",
+    "1+(2*(3+(4*(5+(6*(7+8))))))",
+    "12345678.9012345*9876543.21",
+    "99999999999+0.000000001",
+    "0.000001234*0.000005678",
+    "1/3/7/11/13/17/19/23/29/31/37",
+    "1000000/3/3/3/3/3/3/3/3/3/3",
+    "1+2*3-4/5+6*7-8/9+1*2-3/4+5*6",
+    "-1*-2*-3*-4*-5*-6*-7*-8*-9",
+    "1/(2-2)",
+    "((1+2",
+};
+
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+// ==================== Stages ====================
+
+#define STAGE_INPUT 0
+#define STAGE_FORMAT 1
+#define STAGE_EVALUATE 2
+#define STAGE_LCD_DRAW 3
+#define STAGE_LCD_SEND 4
+#define STAGE_COUNT 5
+
+static char code *code stageNames[STAGE_COUNT] = {
+    "input", "format", "evaluate", "lcd_draw", "lcd_send"};
+
+static unsigned long xdata stageTotal[STAGE_COUNT];
+static unsigned long xdata stageMax[STAGE_COUNT];
+
+// ==================== Output ====================
+
+/**
+ * Print and accumulate one measurement
+ * @param index Expression index
+ * @param stage Stage number
+ * @param cycles Measured cycles
+ */
+static void Record(unsigned char index, unsigned char stage, unsigned long cycles)
+{
+  stageTotal[stage] += cycles;
+  if (cycles > stageMax[stage])
+  {
+    stageMax[stage] = cycles;
+  }
+
+  Sim_PutNumber(index);
+  Sim_PutChar(',');
+  Sim_PutString(stageNames[stage]);
+  Sim_PutChar(',');
+  Sim_PutNumber(cycles);
+  Sim_PutChar('\n');
+}
+
+static void PutSummary(char code *label, unsigned long xdata *values)
+{
+  unsigned char stage;
+
+  for (stage = 0; stage < STAGE_COUNT; stage++)
+  {
+    Sim_PutString(label);
+    Sim_PutChar(',');
+    Sim_PutString(stageNames[stage]);
+    Sim_PutChar(',');
+    Sim_PutNumber(values[stage]);
+    Sim_PutChar('\n');
+  }
+}
+
+void main(void)
+{
+  char xdata result[LCD_DISPLAY_WIDTH + 1];
+  char code *expr;
+  unsigned char i;
+
+  Sim_Init();
+  Cycles_Init();
+  Calculator_Init();
+
+  Sim_PutString("expr,stage,cycles\n");
+  for (i = 0; i < CORPUS_SIZE; i++)
+  {
+    expr = corpus[i];
+    Calculator_Clear();
+
+    Cycles_Start();
+    while (*expr != '\0')
+    {
+      Calculator_InputChar(*expr);
+      expr++;
+    }
+    Record(i, STAGE_INPUT, Cycles_Stop());
+
+    Cycles_Start();
+    Calculator_GetPreview(result);
+    Record(i, STAGE_FORMAT, Cycles_Stop());
+
+    Cycles_Start();
+    Calculator_Evaluate(result);
+    Record(i, STAGE_EVALUATE, Cycles_Stop());
+
+    // Draw the way main.c does after a key
+    Cycles_Start();
+    LCD_ClearRow(0);
+    LCD_ShowStringAt(0, 0, Calculator_GetExpression());
+    LCD_SetShift(Calculator_GetMaxScrollOffset());
+    LCD_ShowStringAt(1, 0, "                ");
+    LCD_ShowStringAt(1, 0, result);
+    LCD_Flush();
+    Record(i, STAGE_LCD_DRAW, Cycles_Stop());
+
+    // A tick may send several writes, so tick until the queue is empty
+    Cycles_Start();
+    while (LCD_GetQueued() > 0)
+    {
+      LCD_Tick();
+    }
+    Record(i, STAGE_LCD_SEND, Cycles_Stop());
+  }
+
+  PutSummary("total", stageTotal);
+  PutSummary("max", stageMax);
+  Sim_PutString("max,stack_arena,");
+  Sim_PutNumber(Stack_GetPeakUse());
+  Sim_PutChar('\n');
+
+  Sim_Halt();
+}
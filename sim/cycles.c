@@ -0,0 +1,52 @@
+#include "cycles.h"
+
+// Timer2 in 16-bit auto-reload mode (reload 0) counts machine cycles; its
+// interrupt extends the count to 32 bits
+
+static unsigned int cycleOverflows;
+static unsigned int cycleOverhead = 0; // Cycles of a Start/Stop pair
+
+HAL_ISR(Cycles_Timer2_ISR, 5)
+{
+  TF2 = 0;
+  cycleOverflows++;
+}
+
+void Cycles_Init(void)
+{
+  T2CON = 0x00;
+  RCAP2H = 0;
+  RCAP2L = 0;
+  ET2 = 1;
+  EA = 1;
+
+  Cycles_Start();
+  cycleOverhead = (unsigned int)Cycles_Stop();
+}
+
+void Cycles_Start(void)
+{
+  TR2 = 0;
+  TH2 = 0;
+  TL2 = 0;
+  TF2 = 0;
+  cycleOverflows = 0;
+  TR2 = 1;
+}
+
+unsigned long Cycles_Stop(void)
+{
+  unsigned long cycles;
+
+  TR2 = 0;
+  ET2 = 0;
+  if (TF2) // Overflow not serviced yet
+  {
+    TF2 = 0;
+    cycleOverflows++;
+  }
+  ET2 = 1;
+
+  cycles = ((unsigned long)cycleOverflows << 16) | ((unsigned int)TH2 << 8) | TL2;
+  return cycles - cycleOverhead;
+}
@@ -0,0 +1,30 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include "hal.h"
+
+// Machine cycle counter for the simulator programs (see Makefile):
+// Timer2 in 16-bit auto-reload mode, extended to 32 bits by its interrupt
+
+/**
+ * Start Timer2 as the cycle counter and enable interrupts
+ */
+void Cycles_Init(void);
+
+/**
+ * Start counting machine cycles
+ */
+void Cycles_Start(void);
+
+/**
+ * Stop counting machine cycles
+ * @return Cycles since Cycles_Start, without the cost of the pair
+ */
+unsigned long Cycles_Stop(void);
+
+/**
+ * Timer2 interrupt: extends the count to 32 bits
+ */
+HAL_ISR(Cycles_Timer2_ISR, 5);
+
+#endif // CYCLES_H
@@ -0,0 +1,134 @@
+// Calibration of the DJNZ busy delay (delay.h), run under the ucsim s51
+// simulator (see Makefile). Timer0 counts the machine cycles of
+// delayLoop and delayMicroseconds calls with constant arguments, the way
+// lcd.c uses them, and compares them with the cycle model in delay.h for
+// the configured oscillator (F_OSC, CLOCK_MODE). Results are written to
+// the serial port as CSV lines:
+//   loop,<count>,<required>,<expected>,<measured>,<ok>
+//   us,<microseconds>,<required>,<expected>,<measured>,<ok>
+//   failed,<rows>
+//
+// required is the wait the call must reach at least (for us rows, the
+// microseconds in machine cycles at F_CYCLE, rounded up), expected is
+// DELAY_LOOP_OVERHEAD + 2 * count. A row is ok if the measured cycles
+// equal the model and reach the required wait.
+
+#include "hal.h"
+#include "config.h"
+#include "delay.h"
+#include "simio.h"
+
+static unsigned int timerOverhead; // Cycles of a start/stop pair
+static unsigned char failed = 0;
+
+/**
+ * Read the stopped Timer0
+ * @return Timer0 count
+ */
+static unsigned int Timer0_Read(void)
+{
+  return ((unsigned int)TH0 << 8) | TL0;
+}
+
+// Count the machine cycles of a call with Timer0 (stopped around it so
+// the measurement is not disturbed by reading the timer)
+#define MEASURE(call, cycles)               \
+  do                                        \
+  {                                         \
+    TH0 = 0;                                \
+    TL0 = 0;                                \
+    TR0 = 1;                                \
+    call;                                   \
+    TR0 = 0;                                \
+    cycles = Timer0_Read() - timerOverhead; \
+  } while (0)
+
+/**
+ * Send one result line and count failures
+ * @param kind "loop" or "us"
+ * @param arg Loop count or microseconds
+ * @param required Cycles the call must reach at least
+ * @param expected Cycles from the delay.h model
+ * @param measured Measured cycles
+ */
+static void Report(char code *kind, unsigned int arg, unsigned long required,
+                   unsigned int expected, unsigned int measured)
+{
+  unsigned char ok = measured == expected && measured >= required;
+
+  if (!ok)
+  {
+    failed++;
+  }
+
+  Sim_PutString(kind);
+  Sim_PutChar(',');
+  Sim_PutNumber(arg);
+  Sim_PutChar(',');
+  Sim_PutNumber(required);
+  Sim_PutChar(',');
+  Sim_PutNumber(expected);
+  Sim_PutChar(',');
+  Sim_PutNumber(measured);
+  Sim_PutString(ok ? ",ok\n" : ",FAIL\n");
+}
+
+// delayLoop with a constant count
+#define CHECK_LOOP(count)                                                   \
+  do                                                                        \
+  {                                                                         \
+    MEASURE(delayLoop(count), cycles);                                      \
+    Report("loop", count, DELAY_LOOP_OVERHEAD + 2 * (count),                \
+           DELAY_LOOP_OVERHEAD + 2 * (count), cycles);                      \
+  } while (0)
+
+// delayMicroseconds with a constant wait
+#define CHECK_US(us)                                                        \
+  do                                                                        \
+  {                                                                         \
+    MEASURE(delayMicroseconds(us), cycles);                                 \
+    Report("us", us, DELAY_US_CYCLES(us),                                   \
+           DELAY_LOOP_OVERHEAD + 2 * DELAY_US_LOOPS(us), cycles);           \
+  } while (0)
+
+void main(void)
+{
+  unsigned int cycles;
+
+  Sim_Init();
+
+  // Timer0 in mode 1 (16-bit), free running while enabled, no interrupt
+  ET0 = 0;
+  TMOD = (TMOD & 0xF0) | 0x01;
+  TH0 = 0;
+  TL0 = 0;
+  TR0 = 1;
+  TR0 = 0;
+  timerOverhead = Timer0_Read();
+
+  Sim_PutString("f_osc,");
+  Sim_PutNumber(F_OSC);
+  Sim_PutString("\nclock_mode,");
+  Sim_PutNumber(CLOCK_MODE);
+  Sim_PutString("\nkind,arg,required,expected,measured,result\n");
+
+  CHECK_LOOP(1);
+  CHECK_LOOP(2);
+  CHECK_LOOP(10);
+  CHECK_LOOP(100);
+  CHECK_LOOP(255);
+
+  // lcd.c waits 50 us; the others cover the rounding at small waits
+  CHECK_US(1);
+  CHECK_US(2);
+  CHECK_US(5);
+  CHECK_US(10);
+  CHECK_US(37);
+  CHECK_US(50);
+
+  Sim_PutString("failed,");
+  Sim_PutNumber(failed);
+  Sim_PutChar('\n');
+
+  Sim_Halt();
+}
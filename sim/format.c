@@ -0,0 +1,134 @@
+// Cycle benchmark of the result formatter, run under the ucsim s51
+// simulator (see Makefile): formats a fixed set of float values with
+// Number_ToString (double dabble), or with FORMAT_SPRINTF=1 with the
+// sprintf formatter it replaced. Results are written to the serial port
+// as CSV lines:
+//   <value index>,<cycles>,<text>  one per value
+//   total,<cycles>                 sum over the values
+//   max,<cycles>                   worst value
+//
+// The values stay below 2^31, the limit of the sprintf formatter. make
+// format compares the cycles and the code size of the two builds; the
+// code size is the whole program, so the double dabble build includes
+// the float arithmetic of number.c and the sprintf build the float to
+// long conversions and sprintf itself.
+
+#include "hal.h"
+#include "number.h"
+#include "calculator.h"
+#include "simio.h"
+#include "cycles.h"
+
+#if NUMBER_BACKEND != NUMBER_BACKEND_FLOAT
+#error "The formatter comparison needs the float backend"
+#endif
+
+#ifndef FORMAT_SPRINTF
+#define FORMAT_SPRINTF 0
+#endif
+
+#if FORMAT_SPRINTF
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Convert a float to a string with 5 decimals, trailing zeros removed
+ * (the formatter used before Number_ToString)
+ * @param value Value to convert
+ * @param buffer Output buffer (at least 17 bytes)
+ */
+static void FloatToString(float value, char *buffer)
+{
+  long intPart;
+  long fracPart;
+  unsigned char i;
+  unsigned char negative = 0;
+
+  // Handle negative numbers
+  if (value < 0)
+  {
+    negative = 1;
+    value = -value;
+  }
+
+  // Round to 5 decimal places
+  value += 0.000005;
+
+  // Extract integer and fractional parts
+  intPart = (long)value;
+  fracPart = (long)((value - intPart) * 100000);
+
+  // Format output using sprintf
+  if (negative)
+  {
+    sprintf(buffer, "-%ld.%05ld", intPart, fracPart);
+  }
+  else
+  {
+    sprintf(buffer, "%ld.%05ld", intPart, fracPart);
+  }
+
+  // Remove trailing zeros (keep at least 1 decimal place)
+  i = strlen(buffer) - 1;
+  while (i > 0 && buffer[i] == '0' && buffer[i - 1] != '.')
+  {
+    buffer[i] = '\0';
+    i--;
+  }
+}
+#endif
+
+// Typical results: integers, short and long fractions, negative values
+static float code values[] = {
+    0.0, 1.0, -1.0, 14.0, 767.0, 0.5, 0.3333333, 3.14159,
+    -2.75, 100.0 / 7.0, 531441.0, -362880.0, 12345.678, 0.00001234,
+    98765432.0, 2000000000.0};
+
+#define VALUE_COUNT (sizeof(values) / sizeof(values[0]))
+
+void main(void)
+{
+  char xdata text[LCD_DISPLAY_WIDTH + 1];
+  unsigned long cycles, total = 0, max = 0;
+  unsigned char i;
+  char *c;
+
+  Sim_Init();
+  Cycles_Init();
+
+  Sim_PutString("value,cycles,text\n");
+  for (i = 0; i < VALUE_COUNT; i++)
+  {
+    Cycles_Start();
+#if FORMAT_SPRINTF
+    FloatToString(values[i], text);
+#else
+    Number_ToString(values[i], text);
+#endif
+    cycles = Cycles_Stop();
+
+    total += cycles;
+    if (cycles > max)
+    {
+      max = cycles;
+    }
+
+    Sim_PutNumber(i);
+    Sim_PutChar(',');
+    Sim_PutNumber(cycles);
+    Sim_PutChar(',');
+    for (c = text; *c != '\0'; c++)
+    {
+      Sim_PutChar(*c);
+    }
+    Sim_PutChar('\n');
+  }
+
+  Sim_PutString("total,");
+  Sim_PutNumber(total);
+  Sim_PutString("\nmax,");
+  Sim_PutNumber(max);
+  Sim_PutChar('\n');
+
+  Sim_Halt();
+}
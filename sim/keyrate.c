@@ -0,0 +1,220 @@
+// Keystroke rate test of the keyboard driver, run under the ucsim s51
+// simulator (see Makefile). A Timer2 interrupt presses and releases the
+// ')' and backspace keys in turn by pulling their P3 pins low, at a fixed
+// rate and independent of the main loop. The main loop handles each key
+// event the way main.c handles a typed character (calculator input,
+// preview, LCD drawing). A rate is sustained if every press arrives once,
+// in order, with non-decreasing timestamps. Results are written to the
+// serial port as CSV lines:
+//   <keys per second>,<hold ms>,<sent>,<received>,<queue overflows>,<ok>
+//   max_rate,<keys per second>   fastest rate sustained by it and every
+//                                slower rate (0 if none)
+//
+// Presses are at least three key samples long, the shortest the
+// debounce accepts; shorter ones are rejected as bounce by design. The
+// build sets UART_ENABLE so the keyboard ignores the serial port pins.
+
+#include "hal.h"
+#include "calculator.h"
+#include "keyboard.h"
+#include "timer.h"
+#include "power.h"
+#include "lcd.h"
+#include "simio.h"
+
+// Presses per rate
+#define PRESS_COUNT 40
+
+// Key press periods in ms (press and release take half each), slowest first
+static unsigned char code periods[] = {100, 80, 60, 50, 40, 32, 28, 24};
+
+#define PERIOD_COUNT (sizeof(periods) / sizeof(periods[0]))
+
+// Characters typed for the key events, so each event costs the main loop
+// a realistic amount of work
+static char code typed[] = "12345678.9012345*9876543.21-1/3+";
+
+// ==================== Key Presser ====================
+// Timer2 interrupt every millisecond (same reload as the system tick)
+
+static volatile unsigned char pressesLeft = 0;
+static unsigned char holdMs;       // Milliseconds per press and per release
+static unsigned char phaseLeft;    // Milliseconds left in the current phase
+static bit pressDown = 0;          // A key is held
+static bit pressBackspace = 0;     // Key being pressed: backspace, else ')'
+
+HAL_ISR(KeyPresser_ISR, 5)
+{
+  TF2 = 0;
+
+  if (phaseLeft > 1)
+  {
+    phaseLeft--;
+    return;
+  }
+  phaseLeft = holdMs;
+
+  if (pressDown)
+  {
+    KEY_RIGHT_PAREN = 1;
+    KEY_BACKSPACE = 1;
+    pressDown = 0;
+    pressBackspace = !pressBackspace;
+    pressesLeft--;
+  }
+  else if (pressesLeft > 0)
+  {
+    if (pressBackspace)
+    {
+      KEY_BACKSPACE = 0;
+    }
+    else
+    {
+      KEY_RIGHT_PAREN = 0;
+    }
+    pressDown = 1;
+  }
+}
+
+/**
+ * Start pressing keys
+ * @param period Milliseconds per press and release
+ */
+static void StartPresses(unsigned char period)
+{
+  TR2 = 0;
+  holdMs = period / 2;
+  phaseLeft = holdMs;
+  pressBackspace = 0;
+  pressesLeft = PRESS_COUNT;
+  TF2 = 0;
+  TR2 = 1;
+}
+
+// ==================== Main Loop ====================
+
+static char xdata resultBuffer[LCD_DISPLAY_WIDTH + 1];
+static unsigned char typedIndex = 0;
+
+/**
+ * Handle a key event like main.c handles a typed character
+ */
+static void HandleKey(void)
+{
+  if (!Calculator_InputChar(typed[typedIndex]))
+  {
+    Calculator_Clear();
+  }
+  typedIndex = (typedIndex + 1) % (sizeof(typed) - 1);
+
+  LCD_ClearRow(0);
+  LCD_ShowStringAt(0, 0, Calculator_GetExpression());
+  LCD_SetShift(Calculator_GetMaxScrollOffset());
+  LCD_ShowStringAt(1, 0, "                ");
+  if (Calculator_GetPreview(resultBuffer))
+  {
+    LCD_ShowStringAt(1, 0, resultBuffer);
+  }
+  LCD_Flush();
+}
+
+/**
+ * Run one rate and report it
+ * @param period Milliseconds per key press
+ * @return 1 if every press arrived in order, 0 otherwise
+ */
+static unsigned char RunRate(unsigned char period)
+{
+  KeyEvent event;
+  unsigned char received = 0;
+  unsigned char ok = 1;
+  unsigned char expectBackspace = 0;
+  unsigned int lastTime = 0;
+  unsigned int overflows = Keyboard_GetOverflowCount();
+  unsigned int settle;
+
+  StartPresses(period);
+
+  // Handle events until the presses are done and the last release has
+  // been debounced
+  settle = 0;
+  while (pressesLeft > 0 || Timer_GetTicks() - settle < 3 * period)
+  {
+    if (pressesLeft > 0)
+    {
+      settle = Timer_GetTicks();
+    }
+    if (!Keyboard_GetEvent(&event))
+    {
+      continue;
+    }
+
+    if (event.key != (expectBackspace ? KEY_BACKSPACE_CHAR : KEY_RIGHT_PAREN_CHAR) ||
+        (received > 0 && (unsigned int)(event.time - lastTime) > 0x8000))
+    {
+      ok = 0;
+    }
+    expectBackspace = event.key == KEY_RIGHT_PAREN_CHAR;
+    lastTime = event.time;
+    received++;
+
+    HandleKey();
+  }
+  overflows = Keyboard_GetOverflowCount() - overflows;
+  if (received != PRESS_COUNT || overflows != 0)
+  {
+    ok = 0;
+  }
+
+  Sim_PutNumber(1000 / period);
+  Sim_PutChar(',');
+  Sim_PutNumber(period / 2);
+  Sim_PutChar(',');
+  Sim_PutNumber(PRESS_COUNT);
+  Sim_PutChar(',');
+  Sim_PutNumber(received);
+  Sim_PutChar(',');
+  Sim_PutNumber(overflows);
+  Sim_PutChar(',');
+  Sim_PutString(ok ? "ok\n" : "lost\n");
+  return ok;
+}
+
+void main(void)
+{
+  unsigned char i;
+  unsigned char maxRate = 0;
+  unsigned char lost = 0;
+
+  Sim_Init();
+  Keyboard_Init();
+  Timer_Init();
+  Calculator_Init();
+
+  // Key presser: Timer2 in 16-bit auto-reload mode, one interrupt per ms
+  T2CON = 0x00;
+  RCAP2H = TICK_RELOAD >> 8;
+  RCAP2L = TICK_RELOAD & 0xFF;
+  ET2 = 1;
+
+  Sim_PutString("keys_per_s,hold_ms,sent,received,overflows,result\n");
+  for (i = 0; i < PERIOD_COUNT; i++)
+  {
+    // Only count rates up to the first one that loses presses
+    if (RunRate(periods[i]) && !lost)
+    {
+      maxRate = 1000 / periods[i];
+    }
+    else
+    {
+      lost = 1;
+    }
+  }
+  TR2 = 0;
+
+  Sim_PutString("max_rate,");
+  Sim_PutNumber(maxRate);
+  Sim_PutChar('\n');
+
+  Sim_Halt();
+}
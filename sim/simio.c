@@ -0,0 +1,61 @@
+#include "simio.h"
+
+// ==================== Serial Port ====================
+
+void Sim_Init(void)
+{
+  // Serial port: mode 1, Timer1 baud rate generator (the simulator does
+  // not need an exact rate)
+  SCON = 0x50;
+  TMOD = (TMOD & 0x0F) | 0x20;
+  TH1 = 0xF3;
+  TL1 = 0xF3;
+  PCON |= 0x80;
+  TR1 = 1;
+  TI = 1;
+}
+
+void Sim_PutChar(char c)
+{
+  while (!TI)
+  {
+  }
+  TI = 0;
+  SBUF = c;
+}
+
+void Sim_PutString(char code *str)
+{
+  while (*str != '\0')
+  {
+    Sim_PutChar(*str);
+    str++;
+  }
+}
+
+void Sim_PutNumber(unsigned long value)
+{
+  char digits[10];
+  unsigned char len = 0;
+
+  do
+  {
+    digits[len++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+
+  while (len > 0)
+  {
+    Sim_PutChar(digits[--len]);
+  }
+}
+
+void Sim_Halt(void)
+{
+  // Let the last character leave, then stop the simulator on an
+  // undefined opcode
+  while (!TI)
+  {
+  }
+  __asm__(".db 0xA5");
+}
@@ -0,0 +1,38 @@
+#ifndef SIMIO_H
+#define SIMIO_H
+
+#include "hal.h"
+
+// Support for the programs run under the ucsim s51 simulator (see
+// Makefile): CSV output on the serial port, and stopping the simulator.
+// The machine cycle counter is in cycles.h.
+
+/**
+ * Start the serial port (Timer1 baud rate generator, polled output)
+ */
+void Sim_Init(void);
+
+/**
+ * Send a character (polled)
+ * @param c Character to send
+ */
+void Sim_PutChar(char c);
+
+/**
+ * Send a string from code memory
+ * @param str Zero-terminated string
+ */
+void Sim_PutString(char code *str);
+
+/**
+ * Send an unsigned number in decimal
+ * @param value Number to send
+ */
+void Sim_PutNumber(unsigned long value);
+
+/**
+ * Wait for the last character to leave, then stop the simulator
+ */
+void Sim_Halt(void);
+
+#endif // SIMIO_H
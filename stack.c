@@ -1,12 +1,101 @@
-#include <reg52.h>
+#include "hal.h"
 
 #include "utils.h"
 #include "stack.h"
 
-// ==================== Character Stack Implementation ====================
+// ==================== Undo Journal Data ====================
+
+// Journal entry for a character stack push
+typedef struct
+{
+  unsigned char index; // Overwritten slot
+  char value;          // Previous slot content
+} CharJournalEntry;
+
+// Journal entry for a number stack push
+typedef struct
+{
+  unsigned char index; // Overwritten slot
+  Number value;        // Previous slot content
+} NumberJournalEntry;
+
+// Each journal is a ring buffer. Positions count every push since
+// Journal_Init (modulo 256); entries between the start and end position
+// are still available.
+static CharJournalEntry xdata charJournal[MAX_CHAR_JOURNAL];
+static unsigned char charJournalStart = 0;
+static unsigned char charJournalEnd = 0;
+
+static NumberJournalEntry xdata numberJournal[MAX_NUMBER_JOURNAL];
+static unsigned char numberJournalStart = 0;
+static unsigned char numberJournalEnd = 0;
+
+// Order of the pushes in both journals, one bit per push (1 = number).
+// The stacks share the arena, so a byte may have been overwritten by both
+// kinds of push; Stack_Restore must undo them in reverse order.
+#define PUSH_ORDER_BITS (MAX_CHAR_JOURNAL + MAX_NUMBER_JOURNAL)
+static unsigned char xdata pushOrder[PUSH_ORDER_BITS / 8];
+static unsigned char pushOrderEnd = 0;
+
+/**
+ * Record the kind of a push in pushOrder
+ * @param isNumber 1 for a number push, 0 for a character push
+ */
+static void RecordPush(unsigned char isNumber)
+{
+  unsigned char mask = 1 << (pushOrderEnd % 8);
+
+  if (isNumber)
+  {
+    pushOrder[(pushOrderEnd % PUSH_ORDER_BITS) / 8] |= mask;
+  }
+  else
+  {
+    pushOrder[(pushOrderEnd % PUSH_ORDER_BITS) / 8] &= ~mask;
+  }
+  pushOrderEnd++;
+}
+
+// ==================== Stack Arena Data ====================
+
+// Number slots in the arena
+#define NUMBER_SLOTS (STACK_ARENA_SIZE / sizeof(Number))
+
+// Characters use chars[0] upwards; number i uses numbers[NUMBER_SLOTS - 1 - i]
+static union
+{
+  char chars[STACK_ARENA_SIZE];
+  Number numbers[NUMBER_SLOTS];
+} xdata stackArena;
 
-static char xdata charStack[MAX_CHAR_STACK];
 static unsigned char charStackTop = 0;
+static unsigned char numberStackTop = 0;
+static unsigned char stackPeakUse = 0;
+
+#define NumberSlot(i) (stackArena.numbers[NUMBER_SLOTS - 1 - (i)])
+
+// First arena byte used by the number stack
+#define NumberStackBottom() ((unsigned char)((NUMBER_SLOTS - numberStackTop) * sizeof(Number)))
+
+/**
+ * Update the peak arena use after a push
+ */
+static void UpdatePeakUse(void)
+{
+  unsigned char used = charStackTop + (STACK_ARENA_SIZE - NumberStackBottom());
+
+  if (used > stackPeakUse)
+  {
+    stackPeakUse = used;
+  }
+}
+
+unsigned char Stack_GetPeakUse(void)
+{
+  return stackPeakUse;
+}
+
+// ==================== Character Stack Implementation ====================
 
 void CharStack_Init(void)
 {
@@ -20,22 +109,35 @@ unsigned char CharStack_IsEmpty(void)
 
 unsigned char CharStack_IsFull(void)
 {
-  return charStackTop >= MAX_CHAR_STACK;
+  return charStackTop >= NumberStackBottom();
 }
 
-void CharStack_Push(char ch)
+unsigned char CharStack_Push(char ch)
 {
-  if (!CharStack_IsFull())
+  if (CharStack_IsFull())
+  {
+    return 0;
+  }
+
+  // Drop the oldest entry if the journal is full
+  if ((unsigned char)(charJournalEnd - charJournalStart) == MAX_CHAR_JOURNAL)
   {
-    charStack[charStackTop++] = ch;
+    charJournalStart++;
   }
+  charJournal[charJournalEnd % MAX_CHAR_JOURNAL].index = charStackTop;
+  charJournal[charJournalEnd % MAX_CHAR_JOURNAL].value = stackArena.chars[charStackTop];
+  charJournalEnd++;
+  RecordPush(0);
+  stackArena.chars[charStackTop++] = ch;
+  UpdatePeakUse();
+  return 1;
 }
 
 char CharStack_Pop(void)
 {
   if (!CharStack_IsEmpty())
   {
-    return charStack[--charStackTop];
+    return stackArena.chars[--charStackTop];
   }
   return '\0';
 }
@@ -44,94 +146,126 @@ char CharStack_Peek(void)
 {
   if (!CharStack_IsEmpty())
   {
-    return charStack[charStackTop - 1];
+    return stackArena.chars[charStackTop - 1];
   }
   return '\0';
 }
 
-// ==================== Float Stack Implementation ====================
+char CharStack_PeekAt(unsigned char depth)
+{
+  return stackArena.chars[charStackTop - 1 - depth];
+}
 
-static float xdata floatStack[MAX_FLOAT_STACK];
-static unsigned char floatStackTop = 0;
+unsigned char CharStack_Size(void)
+{
+  return charStackTop;
+}
+
+// ==================== Number Stack Implementation ====================
 
-void FloatStack_Init(void)
+void NumberStack_Init(void)
 {
-  floatStackTop = 0;
+  numberStackTop = 0;
 }
 
-unsigned char FloatStack_IsEmpty(void)
+unsigned char NumberStack_IsEmpty(void)
 {
-  return floatStackTop == 0;
+  return numberStackTop == 0;
 }
 
-unsigned char FloatStack_IsFull(void)
+unsigned char NumberStack_IsFull(void)
 {
-  return floatStackTop >= MAX_FLOAT_STACK;
+  return numberStackTop >= NUMBER_SLOTS || charStackTop > NumberStackBottom() - sizeof(Number);
 }
 
-void FloatStack_Push(float val)
+void NumberStack_Push(Number val)
 {
-  if (!FloatStack_IsFull())
+  if (!NumberStack_IsFull())
   {
-    floatStack[floatStackTop++] = val;
+    // Drop the oldest entry if the journal is full
+    if ((unsigned char)(numberJournalEnd - numberJournalStart) == MAX_NUMBER_JOURNAL)
+    {
+      numberJournalStart++;
+    }
+    numberJournal[numberJournalEnd % MAX_NUMBER_JOURNAL].index = numberStackTop;
+    numberJournal[numberJournalEnd % MAX_NUMBER_JOURNAL].value = NumberSlot(numberStackTop);
+    numberJournalEnd++;
+    RecordPush(1);
+    NumberSlot(numberStackTop) = val;
+    numberStackTop++;
+    UpdatePeakUse();
   }
 }
 
-float FloatStack_Pop(void)
+Number NumberStack_Pop(void)
 {
-  if (!FloatStack_IsEmpty())
+  if (!NumberStack_IsEmpty())
   {
-    return floatStack[--floatStackTop];
+    numberStackTop--;
+    return NumberSlot(numberStackTop);
   }
-  return 0.0;
+  return 0;
 }
 
-unsigned char FloatStack_Size(void)
+Number NumberStack_PeekAt(unsigned char depth)
 {
-  return floatStackTop;
+  return NumberSlot(numberStackTop - 1 - depth);
 }
 
-// ==================== Token Queue Implementation ====================
-
-static Token xdata tokenQueue[MAX_TOKEN_QUEUE];
-static unsigned char tokenQueueLen = 0;
-
-void TokenQueue_Init(void)
+unsigned char NumberStack_Size(void)
 {
-  tokenQueueLen = 0;
+  return numberStackTop;
 }
 
-unsigned char TokenQueue_IsFull(void)
-{
-  return tokenQueueLen >= MAX_TOKEN_QUEUE;
-}
+// ==================== Undo Journal Implementation ====================
 
-void TokenQueue_Add(Token token)
+void Journal_Init(void)
 {
-  if (!TokenQueue_IsFull())
-  {
-    tokenQueue[tokenQueueLen++] = token;
-  }
+  charJournalStart = 0;
+  charJournalEnd = 0;
+  numberJournalStart = 0;
+  numberJournalEnd = 0;
+  pushOrderEnd = 0;
 }
 
-Token *TokenQueue_Get(unsigned char index)
+void Stack_Save(StackMark *mark)
 {
-  if (index < tokenQueueLen)
-  {
-    return &tokenQueue[index];
-  }
-  return NULL;
+  mark->charTop = charStackTop;
+  mark->numberTop = numberStackTop;
+  mark->charJournalLen = charJournalEnd;
+  mark->numberJournalLen = numberJournalEnd;
 }
 
-unsigned char TokenQueue_Length(void)
+unsigned char Stack_CanRestore(StackMark *mark)
 {
-  return tokenQueueLen;
+  // The mark's positions must not be older than the oldest entries kept
+  return (unsigned char)(mark->charJournalLen - charJournalStart) <=
+             (unsigned char)(charJournalEnd - charJournalStart) &&
+         (unsigned char)(mark->numberJournalLen - numberJournalStart) <=
+             (unsigned char)(numberJournalEnd - numberJournalStart);
 }
 
-void TokenQueue_SetLength(unsigned char len)
+void Stack_Restore(StackMark *mark)
 {
-  if (len <= MAX_TOKEN_QUEUE)
+  // Undo pushes of both kinds in reverse order so the oldest content ends
+  // up in each byte
+  while (charJournalEnd != mark->charJournalLen || numberJournalEnd != mark->numberJournalLen)
   {
-    tokenQueueLen = len;
+    pushOrderEnd--;
+    if (pushOrder[(pushOrderEnd % PUSH_ORDER_BITS) / 8] & (1 << (pushOrderEnd % 8)))
+    {
+      numberJournalEnd--;
+      NumberSlot(numberJournal[numberJournalEnd % MAX_NUMBER_JOURNAL].index) =
+          numberJournal[numberJournalEnd % MAX_NUMBER_JOURNAL].value;
+    }
+    else
+    {
+      charJournalEnd--;
+      stackArena.chars[charJournal[charJournalEnd % MAX_CHAR_JOURNAL].index] =
+          charJournal[charJournalEnd % MAX_CHAR_JOURNAL].value;
+    }
   }
+
+  charStackTop = mark->charTop;
+  numberStackTop = mark->numberTop;
 }
@@ -1,11 +1,29 @@
 #ifndef STACK_H
 #define STACK_H
 
-#include "token.h"
+#include "number.h"
 
-// ==================== Character Stack ====================
+// ==================== Stack Arena ====================
+
+// The character stack and the number stack share one arena of
+// STACK_ARENA_SIZE bytes: characters grow up from its start and numbers
+// grow down from its end, so deep nesting (many operators) and long
+// operand chains (many numbers) can each use what the other leaves free.
+// The default is the peak use measured on the sim/bench corpus ("make
+// arena" in host/), rounded up to whole numbers: 1+(2*(3+(4*(5+(6*(7+8))))))
+// holds 8 numbers, 6 operators and 6 parentheses, 45 bytes. Must be a
+// multiple of sizeof(Number).
+#ifndef STACK_ARENA_SIZE
+#define STACK_ARENA_SIZE 48
+#endif
+
+/**
+ * Get the largest number of arena bytes in use at any time since startup
+ * @return Peak arena use in bytes
+ */
+unsigned char Stack_GetPeakUse(void);
 
-#define MAX_CHAR_STACK 16
+// ==================== Character Stack ====================
 
 /**
  * Initialize character stack
@@ -27,8 +45,9 @@ unsigned char CharStack_IsFull(void);
 /**
  * Push a character onto the stack
  * @param ch Character to push
+ * @return 1=success, 0=failure (arena full)
  */
-void CharStack_Push(char ch);
+unsigned char CharStack_Push(char ch);
 
 /**
  * Pop a character from the stack
@@ -42,83 +61,109 @@ char CharStack_Pop(void);
  */
 char CharStack_Peek(void);
 
-// ==================== Float Stack ====================
+/**
+ * Peek at a character below the top without removing it
+ * @param depth 0 for the top character, 1 for the one below it, ...
+ *              (must be less than CharStack_Size)
+ * @return The character
+ */
+char CharStack_PeekAt(unsigned char depth);
 
-#define MAX_FLOAT_STACK 8
+/**
+ * Get the current size of the character stack
+ * @return Number of elements in the stack
+ */
+unsigned char CharStack_Size(void);
+
+// ==================== Number Stack ====================
 
 /**
- * Initialize float stack
+ * Initialize number stack
  */
-void FloatStack_Init(void);
+void NumberStack_Init(void);
 
 /**
- * Check if float stack is empty
+ * Check if number stack is empty
  * @return 1 if empty, 0 otherwise
  */
-unsigned char FloatStack_IsEmpty(void);
+unsigned char NumberStack_IsEmpty(void);
 
 /**
- * Check if float stack is full
+ * Check if number stack is full
  * @return 1 if full, 0 otherwise
  */
-unsigned char FloatStack_IsFull(void);
+unsigned char NumberStack_IsFull(void);
 
 /**
- * Push a float value onto the stack
- * @param val Float value to push
+ * Push a number onto the stack
+ * @param val Number to push
  */
-void FloatStack_Push(float val);
+void NumberStack_Push(Number val);
 
 /**
- * Pop a float value from the stack
- * @return The popped value, or 0.0 if stack is empty
+ * Pop a number from the stack
+ * @return The popped value, or 0 if stack is empty
  */
-float FloatStack_Pop(void);
+Number NumberStack_Pop(void);
 
 /**
- * Get the current size of the float stack
- * @return Number of elements in the stack
+ * Peek at a number below the top without removing it
+ * @param depth 0 for the top number, 1 for the one below it, ...
+ *              (must be less than NumberStack_Size)
+ * @return The number
  */
-unsigned char FloatStack_Size(void);
-
-// ==================== Token Queue ====================
-
-#define MAX_TOKEN_QUEUE 32
+Number NumberStack_PeekAt(unsigned char depth);
 
 /**
- * Initialize token queue
+ * Get the current size of the number stack
+ * @return Number of elements in the stack
  */
-void TokenQueue_Init(void);
+unsigned char NumberStack_Size(void);
 
-/**
- * Check if token queue is full
- * @return 1 if full, 0 otherwise
- */
-unsigned char TokenQueue_IsFull(void);
+// ==================== Undo Journal ====================
+
+// Every push records the slot value it overwrites, so both stacks can be
+// rolled back to an earlier mark. When a journal is full the oldest entry
+// is dropped, and marks saved before it can no longer be restored (the
+// calculator then replays the expression instead). The sizes cover the
+// last operators and operands typed, which is where backspace goes.
+// Sizes must be powers of two (at most 128), and so must their sum.
+#define MAX_CHAR_JOURNAL 16
+#define MAX_NUMBER_JOURNAL 16
+
+// Saved stack position
+typedef struct
+{
+  unsigned char charTop;          // Character stack size
+  unsigned char numberTop;        // Number stack size
+  unsigned char charJournalLen;   // Character journal position
+  unsigned char numberJournalLen; // Number journal position
+} StackMark;
 
 /**
- * Add a token to the queue
- * @param token Token to add
+ * Clear the undo journal
+ * Call together with CharStack_Init and NumberStack_Init
  */
-void TokenQueue_Add(Token token);
+void Journal_Init(void);
 
 /**
- * Get a token from the queue by index
- * @param index Index of the token
- * @return Pointer to the token
+ * Save the current position of both stacks
+ * @param mark Mark to fill in
  */
-Token *TokenQueue_Get(unsigned char index);
+void Stack_Save(StackMark *mark);
 
 /**
- * Get the current length of the token queue
- * @return Number of tokens in the queue
+ * Check if the journal still holds everything needed to restore a mark
+ * @param mark Mark previously filled in by Stack_Save
+ * @return 1 if the mark can be restored, 0 otherwise
  */
-unsigned char TokenQueue_Length(void);
+unsigned char Stack_CanRestore(StackMark *mark);
 
 /**
- * Set the length of the token queue
- * @param len New length
+ * Roll both stacks back to a saved position
+ * Marks saved after this one become invalid
+ * @param mark Mark previously filled in by Stack_Save (see Stack_CanRestore)
  */
-void TokenQueue_SetLength(unsigned char len);
+void Stack_Restore(StackMark *mark);
 
 #endif // STACK_H
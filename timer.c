@@ -0,0 +1,56 @@
+#include "timer.h"
+#include "keyboard.h"
+#include "lcd.h"
+#include "power.h"
+#include "profile.h"
+
+// Ticks since Timer_Init
+static volatile unsigned int timerTicks = 0;
+
+/**
+ * @brief Start the Timer0 system tick and enable interrupts
+ */
+void Timer_Init(void)
+{
+  TMOD = (TMOD & 0xF0) | 0x01; // Timer0 mode 1 (16-bit timer)
+  TH0 = TICK_RELOAD >> 8;
+  TL0 = TICK_RELOAD & 0xFF;
+  timerTicks = 0;
+  ET0 = 1; // Enable Timer0 interrupt
+  TR0 = 1; // Start Timer0
+  EA = 1;  // Enable interrupts
+}
+
+/**
+ * @brief Timer0 interrupt: system tick
+ */
+HAL_ISR(Timer0_ISR, 1)
+{
+  // Reload for the next tick
+  TH0 = TICK_RELOAD >> 8;
+  TL0 = TICK_RELOAD & 0xFF;
+
+  timerTicks++;
+  Power_Tick();
+  PROFILE_BEGIN(PROFILE_KEY_TICK);
+  Keyboard_Tick(timerTicks);
+  PROFILE_END(PROFILE_KEY_TICK);
+  PROFILE_BEGIN(PROFILE_LCD_TICK);
+  LCD_Tick();
+  PROFILE_END(PROFILE_LCD_TICK);
+}
+
+/**
+ * @brief Get the system tick counter
+ * @return Ticks since Timer_Init (wraps around after 65536 ticks)
+ */
+unsigned int Timer_GetTicks(void)
+{
+  unsigned int ticks;
+
+  ET0 = 0; // Read both bytes of the counter from the same tick
+  ticks = timerTicks;
+  ET0 = 1;
+
+  return ticks;
+}
@@ -0,0 +1,30 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "hal.h"
+
+#include "config.h"
+
+// System tick period in milliseconds
+#define TICK_MS 1
+
+// Timer0 reload value for one tick (one timer count per machine cycle)
+#define TICK_RELOAD (65536UL - F_CYCLE / 1000 * TICK_MS)
+
+/**
+ * @brief Start the Timer0 system tick and enable interrupts
+ */
+void Timer_Init(void);
+
+/**
+ * @brief Get the system tick counter
+ * @return Ticks since Timer_Init (wraps around after 65536 ticks)
+ */
+unsigned int Timer_GetTicks(void);
+
+/**
+ * @brief Timer0 interrupt: system tick
+ */
+HAL_ISR(Timer0_ISR, 1);
+
+#endif // TIMER_H
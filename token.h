@@ -13,12 +13,4 @@
 #define OP_MUL '*'
 #define OP_DIV '/'
 
-// Token structure
-typedef struct
-{
-  unsigned char type; // TOKEN_NUMBER, TOKEN_OPERATOR, TOKEN_LPAREN, TOKEN_RPAREN
-  float value;        // Numeric value (valid only when type == TOKEN_NUMBER)
-  char op;            // Operator (valid only when type == TOKEN_OPERATOR)
-} Token;
-
 #endif // TOKEN_H
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "uart.h"
+
+#if UART_ENABLE
+
+// Received bytes, queued by the interrupt and taken by the main loop
+// (head and tail are free-running; each is written by one side only)
+static char xdata uartRxQueue[UART_RX_QUEUE_SIZE];
+static volatile unsigned char uartRxHead = 0; // Next byte to read
+static volatile unsigned char uartRxTail = 0; // Next free slot
+static unsigned int uartOverflowCount = 0;
+
+// Set while a byte is being sent
+static volatile unsigned char uartTxBusy = 0;
+
+/**
+ * @brief Start the serial port and its interrupt
+ */
+void Uart_Init(void)
+{
+  SCON = 0x50;                 // Mode 1, receiver enabled
+  TMOD = (TMOD & 0x0F) | 0x20; // Timer1 mode 2 (8-bit auto-reload)
+  TH1 = UART_RELOAD;
+  TL1 = UART_RELOAD;
+  PCON |= 0x80; // SMOD: double baud rate
+  TR1 = 1;
+
+  uartRxHead = 0;
+  uartRxTail = 0;
+  uartTxBusy = 0;
+  ES = 1; // Enable serial interrupt
+  EA = 1;
+}
+
+/**
+ * @brief Serial port interrupt: queue received bytes, end transmissions
+ */
+HAL_ISR(Uart_ISR, 4)
+{
+  if (RI)
+  {
+    RI = 0;
+    if ((unsigned char)(uartRxTail - uartRxHead) < UART_RX_QUEUE_SIZE)
+    {
+      uartRxQueue[uartRxTail % UART_RX_QUEUE_SIZE] = SBUF;
+      uartRxTail++;
+    }
+    else
+    {
+      uartOverflowCount++;
+    }
+  }
+  if (TI)
+  {
+    TI = 0;
+    uartTxBusy = 0;
+  }
+}
+
+/**
+ * @brief Take the next received byte from the queue (does not wait)
+ * @param ch Pointer to store the byte
+ * @return 1=byte returned, 0=queue is empty
+ */
+unsigned char Uart_GetChar(char *ch)
+{
+  if (uartRxHead == uartRxTail)
+  {
+    return 0;
+  }
+  *ch = uartRxQueue[uartRxHead % UART_RX_QUEUE_SIZE];
+  uartRxHead++;
+  return 1;
+}
+
+/**
+ * @brief Send a byte (waits until the previous byte has been sent)
+ * @param ch Byte to send
+ */
+void Uart_PutChar(char ch)
+{
+  while (uartTxBusy)
+  {
+  }
+  uartTxBusy = 1;
+  SBUF = ch;
+}
+
+/**
+ * @brief Wait until the last byte has left the transmitter
+ */
+void Uart_Flush(void)
+{
+  while (uartTxBusy)
+  {
+  }
+}
+
+/**
+ * @brief Send a string
+ * @param str Zero-terminated string
+ */
+void Uart_PutString(char *str)
+{
+  while (*str != '\0')
+  {
+    Uart_PutChar(*str);
+    str++;
+  }
+}
+
+/**
+ * @brief Send an unsigned number in decimal
+ * @param value Number to send
+ */
+void Uart_PutNumber(unsigned long value)
+{
+  char digits[10];
+  unsigned char len = 0;
+
+  do
+  {
+    digits[len++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+
+  while (len > 0)
+  {
+    Uart_PutChar(digits[--len]);
+  }
+}
+
+/**
+ * @brief Get the number of received bytes dropped because the queue was full
+ * @return Overflow count
+ */
+unsigned int Uart_GetOverflowCount(void)
+{
+  unsigned int count;
+
+  ES = 0; // Read both bytes of the counter at once
+  count = uartOverflowCount;
+  ES = 1;
+
+  return count;
+}
+
+#endif // UART_ENABLE
@@ -0,0 +1,85 @@
+#ifndef UART_H
+#define UART_H
+
+#include "hal.h"
+
+#include "config.h"
+
+// Serial port (mode 1: 8 data bits, no parity, 1 stop bit) with Timer1 as
+// the baud rate generator. It uses P3.0 (RXD) and P3.1 (TXD), which are
+// the '.' and '(' keys: a build with UART_ENABLE=1 ignores those two keys
+// (see keyboard.c).
+#ifndef UART_ENABLE
+#define UART_ENABLE 0
+#endif
+
+// Baud rate (Timer1 reload rounded to the nearest rate the clock allows;
+// 9600 is 9615 at 24 MHz)
+#ifndef UART_BAUD
+#define UART_BAUD 9600
+#endif
+
+// Received bytes the queue can hold (must be a power of two, at most 128);
+// room for the next expression of the batch mode while a result is sent
+#ifndef UART_RX_QUEUE_SIZE
+#define UART_RX_QUEUE_SIZE 64
+#endif
+
+// Timer1 mode 2 reload with SMOD=1: baud = F_CYCLE / 16 / (256 - TH1)
+#define UART_RELOAD (256 - (F_CYCLE / 16 + UART_BAUD / 2) / UART_BAUD)
+
+#if UART_ENABLE
+
+#if (F_CYCLE / 16 + UART_BAUD / 2) / UART_BAUD < 1 || (F_CYCLE / 16 + UART_BAUD / 2) / UART_BAUD > 255
+#error "UART_BAUD cannot be reached with this clock"
+#endif
+
+/**
+ * @brief Start the serial port and its interrupt
+ */
+void Uart_Init(void);
+
+/**
+ * @brief Take the next received byte from the queue (does not wait)
+ * @param ch Pointer to store the byte
+ * @return 1=byte returned, 0=queue is empty
+ */
+unsigned char Uart_GetChar(char *ch);
+
+/**
+ * @brief Send a byte (waits until the previous byte has been sent)
+ * @param ch Byte to send
+ */
+void Uart_PutChar(char ch);
+
+/**
+ * @brief Wait until the last byte has left the transmitter
+ */
+void Uart_Flush(void);
+
+/**
+ * @brief Send a string
+ * @param str Zero-terminated string
+ */
+void Uart_PutString(char *str);
+
+/**
+ * @brief Send an unsigned number in decimal
+ * @param value Number to send
+ */
+void Uart_PutNumber(unsigned long value);
+
+/**
+ * @brief Get the number of received bytes dropped because the queue was full
+ * @return Overflow count
+ */
+unsigned int Uart_GetOverflowCount(void);
+
+/**
+ * @brief Serial port interrupt: queue received bytes, end transmissions
+ */
+HAL_ISR(Uart_ISR, 4);
+
+#endif // UART_ENABLE
+
+#endif // UART_H